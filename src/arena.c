@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "arena.h"
+
+#include "libmodjpeg.h"
+
+#include <jerror.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the chunk header is padded such that the data after it is aligned
+#define MJ_ARENA_HEADERSIZE ((sizeof(mj_arena_chunk_t) + MJ_ARENA_ALIGNMENT - 1) & ~(size_t)(MJ_ARENA_ALIGNMENT - 1))
+
+static void *           mj_arena_alloc_small(j_common_ptr cinfo, int pool_id, size_t sizeofobject);
+static JSAMPARRAY       mj_arena_alloc_sarray(j_common_ptr cinfo, int pool_id, JDIMENSION samplesperrow, JDIMENSION numrows);
+static JBLOCKARRAY      mj_arena_alloc_barray(j_common_ptr cinfo, int pool_id, JDIMENSION blocksperrow, JDIMENSION numrows);
+static void *           mj_arena_alloc_large(mj_arena_t *arena, size_t size);
+static jvirt_barray_ptr mj_arena_request_virt_barray(j_common_ptr cinfo, int pool_id, boolean pre_zero, JDIMENSION blocksperrow, JDIMENSION numrows, JDIMENSION maxaccess);
+static JBLOCKARRAY      mj_arena_access_virt_barray(j_common_ptr cinfo, jvirt_barray_ptr ptr, JDIMENSION start_row, JDIMENSION num_rows, boolean writable);
+
+mj_arena_t *mj_create_arena(size_t chunksize) {
+    mj_arena_t *arena = (mj_arena_t *)calloc(1, sizeof(mj_arena_t));
+    if(arena == NULL) {
+        return NULL;
+    }
+
+    if(chunksize == 0) {
+        chunksize = MJ_ARENA_CHUNKSIZE;
+    }
+
+    arena->chunksize = chunksize;
+
+    return arena;
+}
+
+void mj_reset_arena(mj_arena_t *arena) {
+    if(arena == NULL) {
+        return;
+    }
+
+    // the chunks are kept for the next job. a chunk is only emptied when it is reached again.
+    arena->current = arena->first;
+    if(arena->current != NULL) {
+        arena->current->used = 0;
+    }
+
+    // the used chunks of the large allocations go in front of the free ones
+    if(arena->large_used != NULL) {
+        arena->large_last->next = arena->large;
+        arena->large = arena->large_used;
+        arena->large_used = NULL;
+        arena->large_last = NULL;
+    }
+
+    return;
+}
+
+void mj_free_arena(mj_arena_t *arena) {
+    if(arena == NULL) {
+        return;
+    }
+
+    mj_arena_chunk_t *chunk, *next;
+
+    for(chunk = arena->first; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    for(chunk = arena->large; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    for(chunk = arena->large_used; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    free(arena);
+
+    return;
+}
+
+void *mj_arena_alloc(mj_arena_t *arena, size_t size) {
+    mj_arena_chunk_t *chunk = arena->current;
+    void *            p = NULL;
+    size_t            chunksize;
+
+    size = (size + MJ_ARENA_ALIGNMENT - 1) & ~(size_t)(MJ_ARENA_ALIGNMENT - 1);
+    if(size == 0) {
+        size = MJ_ARENA_ALIGNMENT;
+    }
+
+    // a large allocation would leave most of the current chunk unused
+    if(size > MJ_ARENA_LARGE(arena)) {
+        return mj_arena_alloc_large(arena, size);
+    }
+
+    // move on to the next chunk that has enough room. the rest of the chunks that are passed is lost until the next reset.
+    while(chunk != NULL && chunk->size - chunk->used < size) {
+        chunk = chunk->next;
+        if(chunk != NULL) {
+            chunk->used = 0;
+        }
+    }
+
+    if(chunk == NULL) {
+        chunksize = arena->chunksize;
+        if(chunksize < size) {
+            chunksize = size;
+        }
+
+        if(posix_memalign(&p, MJ_ARENA_ALIGNMENT, MJ_ARENA_HEADERSIZE + chunksize) != 0) {
+            return NULL;
+        }
+
+        chunk = (mj_arena_chunk_t *)p;
+        chunk->size = chunksize;
+        chunk->used = 0;
+
+        // the new chunk goes after the current one, such that it is reached again after a reset
+        if(arena->current == NULL) {
+            chunk->next = arena->first;
+            arena->first = chunk;
+        }
+        else {
+            chunk->next = arena->current->next;
+            arena->current->next = chunk;
+        }
+    }
+
+    arena->current = chunk;
+
+    p = (unsigned char *)chunk + MJ_ARENA_HEADERSIZE + chunk->used;
+    chunk->used += size;
+
+    return p;
+}
+
+static void *mj_arena_alloc_large(mj_arena_t *arena, size_t size) {
+    mj_arena_chunk_t *chunk, **link, **best = NULL;
+    void *            p = NULL;
+
+    // the smallest free chunk that fits is used again, such that the chunks of the previous jobs are enough for the next
+    // one. only the free chunks are searched, there are only a few large allocations per job.
+    for(link = &arena->large; *link != NULL; link = &(*link)->next) {
+        if((*link)->size >= size && (best == NULL || (*link)->size < (*best)->size)) {
+            best = link;
+        }
+    }
+
+    if(best != NULL) {
+        chunk = *best;
+        *best = chunk->next;
+    }
+    else {
+        if(posix_memalign(&p, MJ_ARENA_ALIGNMENT, MJ_ARENA_HEADERSIZE + size) != 0) {
+            return NULL;
+        }
+
+        chunk = (mj_arena_chunk_t *)p;
+        chunk->size = size;
+    }
+
+    chunk->used = chunk->size;
+    chunk->next = arena->large_used;
+    arena->large_used = chunk;
+
+    if(chunk->next == NULL) {
+        arena->large_last = chunk;
+    }
+
+    return (unsigned char *)chunk + MJ_ARENA_HEADERSIZE;
+}
+
+void *mj_alloc(mj_arena_t *arena, size_t size) {
+    void *p;
+
+    if(arena == NULL) {
+        return calloc(size > 0 ? size : 1, 1);
+    }
+
+    p = mj_arena_alloc(arena, size);
+    if(p != NULL) {
+        memset(p, 0, size);
+    }
+
+    return p;
+}
+
+void mj_release(mj_arena_t *arena, void *p) {
+    if(arena == NULL) {
+        free(p);
+    }
+
+    return;
+}
+
+void mj_arena_attach(mj_arena_t *arena, j_common_ptr cinfo) {
+    // libjpeg's allocations for the pools and the virtual block arrays come from the arena
+    if(arena == NULL) {
+        return;
+    }
+
+    cinfo->client_data = arena;
+
+    cinfo->mem->alloc_small = mj_arena_alloc_small;
+    cinfo->mem->alloc_large = mj_arena_alloc_small;
+    cinfo->mem->alloc_sarray = mj_arena_alloc_sarray;
+    cinfo->mem->alloc_barray = mj_arena_alloc_barray;
+
+    mj_arena_attach_arrays(arena, cinfo);
+
+    return;
+}
+
+void mj_arena_attach_arrays(mj_arena_t *arena, j_common_ptr cinfo) {
+    // only the virtual block arrays come from the arena, e.g. for a decompress object that outlives the arena's job
+    if(arena == NULL) {
+        return;
+    }
+
+    cinfo->client_data = arena;
+
+    // the arrays are allocated when they are requested, the whole image is in memory anyways. the compress
+    // object that writes the coefficients has to access them the same way, see mj_write_jpeg().
+    cinfo->mem->request_virt_barray = mj_arena_request_virt_barray;
+    cinfo->mem->access_virt_barray = mj_arena_access_virt_barray;
+
+    return;
+}
+
+static void *mj_arena_alloc_small(j_common_ptr cinfo, int pool_id, size_t sizeofobject) {
+    void *p = mj_arena_alloc((mj_arena_t *)cinfo->client_data, sizeofobject);
+    if(p == NULL) {
+        ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+    }
+
+    return p;
+}
+
+static JSAMPARRAY mj_arena_alloc_sarray(j_common_ptr cinfo, int pool_id, JDIMENSION samplesperrow, JDIMENSION numrows) {
+    JSAMPARRAY result;
+    JSAMPROW   rows;
+    size_t     rowsize = ((size_t)samplesperrow * sizeof(JSAMPLE) + MJ_ARENA_ALIGNMENT - 1) & ~(size_t)(MJ_ARENA_ALIGNMENT - 1);
+    JDIMENSION i;
+
+    result = (JSAMPARRAY)mj_arena_alloc_small(cinfo, pool_id, (size_t)numrows * sizeof(JSAMPROW));
+    rows = (JSAMPROW)mj_arena_alloc_small(cinfo, pool_id, (size_t)numrows * rowsize);
+
+    for(i = 0; i < numrows; i++) {
+        result[i] = rows + i * rowsize;
+    }
+
+    return result;
+}
+
+static JBLOCKARRAY mj_arena_alloc_barray(j_common_ptr cinfo, int pool_id, JDIMENSION blocksperrow, JDIMENSION numrows) {
+    JBLOCKARRAY result;
+    JBLOCKROW   rows;
+    JDIMENSION  i;
+
+    result = (JBLOCKARRAY)mj_arena_alloc_small(cinfo, pool_id, (size_t)numrows * sizeof(JBLOCKROW));
+    rows = (JBLOCKROW)mj_arena_alloc_small(cinfo, pool_id, (size_t)numrows * blocksperrow * sizeof(JBLOCK));
+
+    for(i = 0; i < numrows; i++) {
+        result[i] = rows + (size_t)i * blocksperrow;
+    }
+
+    return result;
+}
+
+static jvirt_barray_ptr mj_arena_request_virt_barray(j_common_ptr cinfo, int pool_id, boolean pre_zero, JDIMENSION blocksperrow, JDIMENSION numrows, JDIMENSION maxaccess) {
+    mj_arena_barray_t *a = (mj_arena_barray_t *)mj_arena_alloc_small(cinfo, pool_id, sizeof(mj_arena_barray_t));
+
+    a->blocksperrow = blocksperrow;
+    a->numrows = numrows;
+    a->rows = mj_arena_alloc_barray(cinfo, pool_id, blocksperrow, numrows);
+
+    if(pre_zero == TRUE && numrows > 0) {
+        memset(a->rows[0], 0, (size_t)numrows * blocksperrow * sizeof(JBLOCK));
+    }
+
+    // the pointer is only passed back to the arena, never dereferenced by libjpeg
+    return (jvirt_barray_ptr)a;
+}
+
+static JBLOCKARRAY mj_arena_access_virt_barray(j_common_ptr cinfo, jvirt_barray_ptr ptr, JDIMENSION start_row, JDIMENSION num_rows, boolean writable) {
+    mj_arena_barray_t *a = (mj_arena_barray_t *)ptr;
+
+    if(start_row + num_rows > a->numrows) {
+        ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+    }
+
+    return a->rows + start_row;
+}
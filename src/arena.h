@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_ARENA_H_
+#define _LIBMODJPEG_ARENA_H_
+
+#include "libmodjpeg.h"
+
+// all allocations from an arena are aligned to a cache line, enough for the blocks and for libjpeg's SIMD code
+#define MJ_ARENA_ALIGNMENT 64
+
+#define MJ_ARENA_CHUNKSIZE (256 * 1024)
+
+// allocations of more than a quarter of a chunk get a chunk of their own
+#define MJ_ARENA_LARGE(arena) ((arena)->chunksize / 4)
+
+typedef struct mj_arena_chunk {
+    struct mj_arena_chunk *next;
+    size_t                 size;
+    size_t                 used;
+} mj_arena_chunk_t;
+
+struct mj_arena {
+    mj_arena_chunk_t *first;
+    mj_arena_chunk_t *current;
+    mj_arena_chunk_t *large;         // the free chunks of the large allocations, searched for the best fit
+    mj_arena_chunk_t *large_used;    // the used chunks of the large allocations, moved to the free ones on a reset
+    mj_arena_chunk_t *large_last;    // the last used chunk, such that a reset takes constant time
+    size_t            chunksize;
+};
+
+// replaces a virtual block array of libjpeg. the whole array is in the arena.
+typedef struct {
+    JBLOCKARRAY rows;
+    JDIMENSION  blocksperrow;
+    JDIMENSION  numrows;
+} mj_arena_barray_t;
+
+void *mj_arena_alloc(mj_arena_t *arena, size_t size);
+void  mj_arena_attach(mj_arena_t *arena, j_common_ptr cinfo);
+void  mj_arena_attach_arrays(mj_arena_t *arena, j_common_ptr cinfo);
+
+// allocate zeroed memory from the arena, or from the heap if arena is NULL. memory from
+// the arena is only released with mj_reset_arena() or mj_free_arena().
+void *mj_alloc(mj_arena_t *arena, size_t size);
+void  mj_release(mj_arena_t *arena, void *p);
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "batch.h"
+
+#include "libmodjpeg.h"
+#include "pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void mj_batch_task(void *arg, int task, int worker);
+static int  mj_batch_job(mj_batch_job_t *job, struct mj_batch_worker *w);
+static int  mj_batch_op(mj_jpeg_t *m, const mj_batch_op_t *op, mj_arena_t *arena);
+static void mj_batch_free_workers(mj_batch_t *b);
+
+int mj_batch_run(mj_batch_job_t *jobs, int njobs, mj_pool_t *pool) {
+    if(jobs == NULL || njobs <= 0) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    mj_batch_t b;
+    int        i;
+
+    b.jobs = jobs;
+    b.nworkers = mj_pool_nworkers(pool);
+
+    // every worker gets its own context and arena with its first job, the jobs don't share anything
+    b.workers = (struct mj_batch_worker *)calloc(b.nworkers, sizeof(struct mj_batch_worker));
+    if(b.workers == NULL) {
+        return MJ_ERR_MEMORY;
+    }
+
+    for(i = 0; i < b.nworkers; i++) {
+        mj_init_jpeg(&b.workers[i].m);
+    }
+
+    for(i = 0; i < njobs; i++) {
+        jobs[i].output = NULL;
+        jobs[i].output_len = 0;
+        jobs[i].rv = MJ_OK;
+    }
+
+    mj_pool_run(pool, mj_batch_task, &b, njobs);
+
+    mj_batch_free_workers(&b);
+
+    for(i = 0; i < njobs; i++) {
+        if(jobs[i].rv != MJ_OK) {
+            return jobs[i].rv;
+        }
+    }
+
+    return MJ_OK;
+}
+
+static void mj_batch_task(void *arg, int task, int worker) {
+    mj_batch_t *            b = (mj_batch_t *)arg;
+    mj_batch_job_t *        job = &b->jobs[task];
+    struct mj_batch_worker *w = &b->workers[worker];
+
+    if(w->ctx == NULL) {
+        w->ctx = mj_create_context();
+    }
+
+    if(w->arena == NULL) {
+        w->arena = mj_create_arena(0);
+        w->m.arena = w->arena;
+    }
+
+    if(w->ctx == NULL || w->arena == NULL) {
+        job->rv = MJ_ERR_MEMORY;
+        return;
+    }
+
+    job->rv = mj_batch_job(job, w);
+
+    mj_reset_arena(w->arena);
+
+    return;
+}
+
+static int mj_batch_job(mj_batch_job_t *job, struct mj_batch_worker *w) {
+    const unsigned char *buffer = NULL;
+    size_t               len = 0;
+    int                  i, rv;
+
+    if(job->ops == NULL && job->nops != 0) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    // the original is only kept if it can be spliced
+    w->m.splice = (job->options & MJ_OPTION_SPLICE) != 0 ? 1 : 0;
+
+    rv = mj_read_jpeg_from_memory_context(&w->m, job->input, job->input_len, job->max_pixel, w->ctx);
+    if(rv != MJ_OK) {
+        return rv;
+    }
+
+    for(i = 0; i < job->nops; i++) {
+        rv = mj_batch_op(&w->m, &job->ops[i], w->arena);
+        if(rv != MJ_OK) {
+            return rv;
+        }
+    }
+
+    rv = mj_write_jpeg_to_memory_context(&w->m, &buffer, &len, job->options, w->ctx);
+    if(rv != MJ_OK) {
+        return rv;
+    }
+
+    // the buffer of the context is overwritten by the next job
+    job->output = (unsigned char *)malloc(len);
+    if(job->output == NULL) {
+        return MJ_ERR_MEMORY;
+    }
+
+    memcpy(job->output, buffer, len);
+    job->output_len = len;
+
+    return MJ_OK;
+}
+
+static int mj_batch_op(mj_jpeg_t *m, const mj_batch_op_t *op, mj_arena_t *arena) {
+    mj_dropon_t d;
+
+    switch(op->type) {
+        case MJ_BATCH_COMPOSE:
+            if(op->dropon == NULL) {
+                return MJ_ERR_NULL_DATA;
+            }
+
+            // the dropon is shared by the jobs, but it is compiled into the arena of the worker
+            d = *op->dropon;
+            d.arena = arena;
+
+            return mj_compose(m, &d, op->align, op->offset_x, op->offset_y);
+        case MJ_BATCH_COMPOSE_COMPILED:
+            return mj_compose_compiled(m, op->compileddropon, op->align, op->offset_x, op->offset_y);
+        case MJ_BATCH_GRAYSCALE:
+            return mj_effect_grayscale(m);
+        case MJ_BATCH_PIXELATE:
+            return mj_effect_pixelate(m);
+        case MJ_BATCH_TINT:
+            return mj_effect_tint(m, op->value[0], op->value[1]);
+        case MJ_BATCH_LUMINANCE:
+            return mj_effect_luminance(m, op->value[0]);
+        case MJ_BATCH_FN:
+            if(op->fn == NULL) {
+                return MJ_ERR_NULL_DATA;
+            }
+
+            return op->fn(m, op->arg);
+        case MJ_BATCH_PIPELINE:
+            return mj_effect_pipeline(m, op->pipeline);
+        case MJ_BATCH_CONTRAST:
+            return mj_effect_contrast(m, op->value[0]);
+        case MJ_BATCH_SATURATION:
+            return mj_effect_saturation(m, op->value[0]);
+        default:
+            break;
+    }
+
+    return MJ_ERR_UNKNOWN_OPERATION;
+}
+
+static void mj_batch_free_workers(mj_batch_t *b) {
+    int i;
+
+    // the images have to be free'd before their context
+    for(i = 0; i < b->nworkers; i++) {
+        mj_free_jpeg(&b->workers[i].m);
+        mj_free_context(b->workers[i].ctx);
+        mj_free_arena(b->workers[i].arena);
+    }
+
+    free(b->workers);
+
+    return;
+}
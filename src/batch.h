@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_BATCH_H_
+#define _LIBMODJPEG_BATCH_H_
+
+#include "libmodjpeg.h"
+
+// everything a worker of a batch keeps from one job to the next
+struct mj_batch_worker {
+    mj_jpeg_t     m;        // its decompress object is reused for the next job
+    mj_context_t *ctx;
+    mj_arena_t *  arena;    // for the coefficients of the image and the compiled dropons, reset after each job
+};
+
+typedef struct {
+    mj_batch_job_t *        jobs;
+    struct mj_batch_worker *workers;
+    int                     nworkers;
+} mj_batch_t;
+
+#endif
@@ -22,10 +22,14 @@
 
 #include "compose.h"
 
+#include "arena.h"
 #include "convolve.h"
 #include "dropon.h"
+#include "image.h"
 #include "libmodjpeg.h"
+#include "splice.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,34 +56,7 @@ int mj_compose(mj_jpeg_t *m, mj_dropon_t *d, unsigned int align, int offset_x, i
     // first we have to calculate the position of the dropon on the image,
     // then we know how we have to crop the dropon. in most cases the
     // dropon is smaller than the image and fully visible.
-
-    // caluclate the horizontal position of the dropon on the image
-    if((align & MJ_ALIGN_LEFT) != 0) {
-        position_x = 0;
-    }
-    else if((align & MJ_ALIGN_RIGHT) != 0) {
-        position_x = m->width - d->width;
-    }
-    else {
-        position_x = m->width / 2 - d->width / 2;
-    }
-
-    // add the horizontal offset to the position
-    position_x += offset_x;
-
-    // calculate the vertival position of the dropon on the image
-    if((align & MJ_ALIGN_TOP) != 0) {
-        position_y = 0;
-    }
-    else if((align & MJ_ALIGN_BOTTOM) != 0) {
-        position_y = m->height - d->height;
-    }
-    else {
-        position_y = m->height / 2 - d->height / 2;
-    }
-
-    // add the vertical offset to the position
-    position_y += offset_y;
+    mj_get_dropon_position(m, d->width, d->height, align, offset_x, offset_y, &position_x, &position_y);
 
     // now that we have the position we can calculate how the
     // droppon needs to be cropped
@@ -133,7 +110,7 @@ int mj_compose(mj_jpeg_t *m, mj_dropon_t *d, unsigned int align, int offset_x, i
     }
 
     // we don't need to do anything if the crop width and height are zero
-    if(crop_w == 0 || crop_h == 0) {
+    if(crop_w <= 0 || crop_h <= 0) {
         return MJ_OK;
     }
 
@@ -154,7 +131,7 @@ int mj_compose(mj_jpeg_t *m, mj_dropon_t *d, unsigned int align, int offset_x, i
     // we can generate the apropriate dropon.
     mj_compileddropon_t cd;
 
-    int rv = mj_compile_dropon(&cd, d, m->cinfo.jpeg_color_space, &m->sampling, blockoffset_x, blockoffset_y, crop_x, crop_y, crop_w, crop_h);
+    int rv = mj_compile_dropon_area(&cd, d, m->cinfo.jpeg_color_space, &m->sampling, blockoffset_x, blockoffset_y, crop_x, crop_y, crop_w, crop_h, MJ_OPTION_NONE);
     if(rv != MJ_OK) {
         return rv;
     }
@@ -171,172 +148,449 @@ int mj_compose(mj_jpeg_t *m, mj_dropon_t *d, unsigned int align, int offset_x, i
         block_y = 0;
     }
 
-    // compoese the dropon and the image
-    rv = mj_compose_with_mask(m, &cd, block_x, block_y);
+    // compoese the dropon and the image. without any transparency the dropon is simply copied.
+    if(mj_compileddropon_is_opaque(&cd) == 1) {
+        rv = mj_compose_without_mask(m, &cd, block_x, block_y, NULL);
+    }
+    else {
+        rv = mj_compose_with_mask(m, &cd, block_x, block_y, NULL);
+    }
 
     mj_free_compileddropon(&cd);
 
     return rv;
 }
 
-int mj_compose_without_mask(mj_jpeg_t *m, mj_compileddropon_t *cd, int block_x, int block_y) {
-    if(m == NULL || cd == NULL) {
+int mj_compose_compiled(mj_jpeg_t *m, mj_compileddropon_t *cd, unsigned int align, int offset_x, int offset_y) {
+    return mj_compose_compiled_parallel(m, cd, align, offset_x, offset_y, NULL);
+}
+
+int mj_compose_compiled_parallel(mj_jpeg_t *m, mj_compileddropon_t *cd, unsigned int align, int offset_x, int offset_y, mj_pool_t *pool) {
+    if(m == NULL || cd == NULL || m->coef == NULL) {
         return MJ_ERR_NULL_DATA;
     }
 
-    int                            c, k, l, i;
-    int                            width_offset = 0, height_offset = 0;
-    int                            width_in_blocks = 0, height_in_blocks = 0;
-    struct jpeg_decompress_struct *cinfo_m;
-    jpeg_component_info *          component_m;
-    JBLOCKARRAY                    blocks_m;
-    JCOEFPTR                       coefs_m;
+    if(cd->image == NULL || cd->alpha == NULL || cd->mask == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
 
-    mj_component_t *imagecomp;
-    mj_block_t *    imageblock;
+    if(cd->blend == MJ_BLEND_NONE) {
+        return MJ_OK;
+    }
 
-    cinfo_m = &m->cinfo;
+    // the compiled dropon only fits images with the same colorspace and sampling
+    // it has been compiled for
+    if(mj_compileddropon_matches(m, cd) == 0) {
+        return MJ_ERR_INCOMPATIBLE_DROPON;
+    }
 
-    for(c = 0; c < cd->image_ncomponents; c++) {
-        component_m = &cinfo_m->comp_info[c];
-        imagecomp = &cd->image[c];
+    int position_x = 0, position_y = 0;
 
-        width_in_blocks = imagecomp->width_in_blocks;
-        height_in_blocks = imagecomp->height_in_blocks;
+    mj_get_dropon_position(m, cd->width, cd->height, align, offset_x, offset_y, &position_x, &position_y);
 
-        width_offset = block_x * component_m->h_samp_factor;
-        height_offset = block_y * component_m->v_samp_factor;
+    // the dropon is completely outside of the image
+    if(position_x >= m->width || position_y >= m->height || position_x + cd->width <= 0 || position_y + cd->height <= 0) {
+        return MJ_OK;
+    }
 
-        // copy the values from the dropon into the image
-        for(l = 0; l < height_in_blocks; l++) {
-            blocks_m = (*cinfo_m->mem->access_virt_barray)((j_common_ptr)&cinfo_m, m->coef[c], height_offset + l, 1, TRUE);
-
-            for(k = 0; k < width_in_blocks; k++) {
-                coefs_m = blocks_m[0][width_offset + k];
-                imageblock = imagecomp->blocks[width_in_blocks * l + k];
-
-                for(i = 0; i < DCTSIZE2; i += 8) {
-                    coefs_m[i + 0] = (int)imageblock[i + 0] / component_m->quant_table->quantval[i + 0];
-                    coefs_m[i + 1] = (int)imageblock[i + 1] / component_m->quant_table->quantval[i + 1];
-                    coefs_m[i + 2] = (int)imageblock[i + 2] / component_m->quant_table->quantval[i + 2];
-                    coefs_m[i + 3] = (int)imageblock[i + 3] / component_m->quant_table->quantval[i + 3];
-                    coefs_m[i + 4] = (int)imageblock[i + 4] / component_m->quant_table->quantval[i + 4];
-                    coefs_m[i + 5] = (int)imageblock[i + 5] / component_m->quant_table->quantval[i + 5];
-                    coefs_m[i + 6] = (int)imageblock[i + 6] / component_m->quant_table->quantval[i + 6];
-                    coefs_m[i + 7] = (int)imageblock[i + 7] / component_m->quant_table->quantval[i + 7];
-                }
-            }
+    // the compiled dropon is padded with its block offset. the position on the
+    // image must result in the same offset, otherwise the blocks don't align.
+    int blockoffset_x = position_x % m->sampling.h_factor;
+    if(blockoffset_x < 0) {
+        blockoffset_x += m->sampling.h_factor;
+    }
+    int blockoffset_y = position_y % m->sampling.v_factor;
+    if(blockoffset_y < 0) {
+        blockoffset_y += m->sampling.v_factor;
+    }
+
+    if(blockoffset_x != cd->blockoffset_x || blockoffset_y != cd->blockoffset_y) {
+        return MJ_ERR_INCOMPATIBLE_DROPON;
+    }
+
+    // the block of the image where the dropon starts. this can be negative if the dropon
+    // is partially off the left or top border. these blocks will be skipped.
+    int block_x = (position_x - blockoffset_x) / m->sampling.h_factor;
+    int block_y = (position_y - blockoffset_y) / m->sampling.v_factor;
+
+    if(mj_compileddropon_is_opaque(cd) == 1) {
+        return mj_compose_without_mask(m, cd, block_x, block_y, pool);
+    }
+
+    return mj_compose_with_mask(m, cd, block_x, block_y, pool);
+}
+
+void mj_get_dropon_position(mj_jpeg_t *m, int width, int height, unsigned int align, int offset_x, int offset_y, int *position_x, int *position_y) {
+    // caluclate the horizontal position of the dropon on the image
+    if((align & MJ_ALIGN_LEFT) != 0) {
+        *position_x = 0;
+    }
+    else if((align & MJ_ALIGN_RIGHT) != 0) {
+        *position_x = m->width - width;
+    }
+    else {
+        *position_x = m->width / 2 - width / 2;
+    }
+
+    // add the horizontal offset to the position
+    *position_x += offset_x;
+
+    // calculate the vertival position of the dropon on the image
+    if((align & MJ_ALIGN_TOP) != 0) {
+        *position_y = 0;
+    }
+    else if((align & MJ_ALIGN_BOTTOM) != 0) {
+        *position_y = m->height - height;
+    }
+    else {
+        *position_y = m->height / 2 - height / 2;
+    }
+
+    // add the vertical offset to the position
+    *position_y += offset_y;
+
+    return;
+}
+
+int mj_compileddropon_matches(mj_jpeg_t *m, mj_compileddropon_t *cd) {
+    int c;
+
+    if(cd->image_colorspace != (int)m->cinfo.jpeg_color_space || cd->image_ncomponents != m->cinfo.num_components) {
+        return 0;
+    }
+
+    if(cd->sampling.max_h_samp_factor != m->sampling.max_h_samp_factor || cd->sampling.max_v_samp_factor != m->sampling.max_v_samp_factor) {
+        return 0;
+    }
+
+    for(c = 0; c < cd->image_ncomponents; c++) {
+        if(cd->image[c].h_samp_factor != m->sampling.samp_factor[c].h_samp_factor || cd->image[c].v_samp_factor != m->sampling.samp_factor[c].v_samp_factor) {
+            return 0;
         }
+    }
 
-        break;
+    return 1;
+}
+
+int mj_compose_without_mask(mj_jpeg_t *m, mj_compileddropon_t *cd, int block_x, int block_y, mj_pool_t *pool) {
+    return mj_compose_blocks(m, cd, block_x, block_y, pool, mj_compose_row_without_mask);
+}
+
+int mj_compose_with_mask(mj_jpeg_t *m, mj_compileddropon_t *cd, int block_x, int block_y, mj_pool_t *pool) {
+    if(cd->options & MJ_OPTION_FIXEDPOINT) {
+        return mj_compose_blocks(m, cd, block_x, block_y, pool, mj_compose_row_with_mask_fixed);
     }
 
-    return MJ_OK;
+    return mj_compose_blocks(m, cd, block_x, block_y, pool, mj_compose_row_with_mask);
 }
 
-int mj_compose_with_mask(mj_jpeg_t *m, mj_compileddropon_t *cd, int block_x, int block_y) {
+int mj_compose_blocks(mj_jpeg_t *m, mj_compileddropon_t *cd, int block_x, int block_y, mj_pool_t *pool, mj_task_fn compose_row) {
     if(m == NULL || cd == NULL) {
         return MJ_ERR_NULL_DATA;
     }
 
-    int                            c, k, l, i;
+    int                            c, l, nrows = 0;
     int                            width_offset = 0, height_offset = 0;
-    int                            width_in_blocks = 0, height_in_blocks = 0;
+    int                            k_start = 0, k_end = 0, l_start = 0, l_end = 0;
+    JDIMENSION                     band_start = 0, band_end = 0;
     struct jpeg_decompress_struct *cinfo_m;
     jpeg_component_info *          component_m;
     JBLOCKARRAY                    blocks_m;
-    JCOEFPTR                       coefs_m;
-    float                          X[DCTSIZE2], Y[DCTSIZE2];
-
-    mj_component_t *imagecomp, *alphacomp;
-    mj_block_t *    imageblock, *alphablock;
+    mj_composerows_t               rows;
 
     cinfo_m = &m->cinfo;
 
     for(c = 0; c < cd->image_ncomponents; c++) {
-        component_m = &cinfo_m->comp_info[c];
-        imagecomp = &cd->image[c];
-        alphacomp = &cd->alpha[c];
+        nrows += cd->image[c].height_in_blocks;
+    }
 
-        width_in_blocks = imagecomp->width_in_blocks;
-        height_in_blocks = imagecomp->height_in_blocks;
+    rows.m = m;
+    rows.cd = cd;
+    rows.nrows = 0;
+    rows.blend = mj_get_blend_block();
+    rows.blend_fixed = mj_get_blend_block_fixed();
+    rows.quantize = mj_get_quantize_block();
+    rows.rows = (mj_composerow_t *)mj_alloc(m->arena, (size_t)nrows * sizeof(mj_composerow_t));
+    if(rows.rows == NULL) {
+        return MJ_ERR_MEMORY;
+    }
+
+    // collect the rows of blocks of the image that are covered by the dropon. accessing the coefficients
+    // isn't thread safe, but the coefficients are kept in memory, i.e. the rows stay where they are.
+    for(c = 0; c < cd->image_ncomponents; c++) {
+        component_m = &cinfo_m->comp_info[c];
 
         width_offset = block_x * component_m->h_samp_factor;
         height_offset = block_y * component_m->v_samp_factor;
 
-        // blend the values from the dropon with the image
-        for(l = 0; l < height_in_blocks; l++) {
-            blocks_m = (*cinfo_m->mem->access_virt_barray)((j_common_ptr)&cinfo_m, m->coef[c], height_offset + l, 1, TRUE);
-
-            for(k = 0; k < width_in_blocks; k++) {
-                coefs_m = blocks_m[0][width_offset + k];
-                imageblock = imagecomp->blocks[width_in_blocks * l + k];
-                alphablock = alphacomp->blocks[width_in_blocks * l + k];
-
-                // de-quantize
-                for(i = 0; i < DCTSIZE2; i += 8) {
-                    coefs_m[i + 0] *= component_m->quant_table->quantval[i + 0];
-                    coefs_m[i + 1] *= component_m->quant_table->quantval[i + 1];
-                    coefs_m[i + 2] *= component_m->quant_table->quantval[i + 2];
-                    coefs_m[i + 3] *= component_m->quant_table->quantval[i + 3];
-                    coefs_m[i + 4] *= component_m->quant_table->quantval[i + 4];
-                    coefs_m[i + 5] *= component_m->quant_table->quantval[i + 5];
-                    coefs_m[i + 6] *= component_m->quant_table->quantval[i + 6];
-                    coefs_m[i + 7] *= component_m->quant_table->quantval[i + 7];
-                }
-
-                // x = x0 - x1
-                for(i = 0; i < DCTSIZE2; i += 8) {
-                    X[i + 0] = imageblock[i + 0] - coefs_m[i + 0];
-                    X[i + 1] = imageblock[i + 1] - coefs_m[i + 1];
-                    X[i + 2] = imageblock[i + 2] - coefs_m[i + 2];
-                    X[i + 3] = imageblock[i + 3] - coefs_m[i + 3];
-                    X[i + 4] = imageblock[i + 4] - coefs_m[i + 4];
-                    X[i + 5] = imageblock[i + 5] - coefs_m[i + 5];
-                    X[i + 6] = imageblock[i + 6] - coefs_m[i + 6];
-                    X[i + 7] = imageblock[i + 7] - coefs_m[i + 7];
-                }
-
-                memset(Y, 0, DCTSIZE2 * sizeof(float));
-
-                // y' = w * x (convolution)
-                for(i = 0; i < DCTSIZE; i++) {
-                    mj_convolve(X, Y, alphablock[(i * DCTSIZE) + 0], i, 0);
-                    mj_convolve(X, Y, alphablock[(i * DCTSIZE) + 1], i, 1);
-                    mj_convolve(X, Y, alphablock[(i * DCTSIZE) + 2], i, 2);
-                    mj_convolve(X, Y, alphablock[(i * DCTSIZE) + 3], i, 3);
-                    mj_convolve(X, Y, alphablock[(i * DCTSIZE) + 4], i, 4);
-                    mj_convolve(X, Y, alphablock[(i * DCTSIZE) + 5], i, 5);
-                    mj_convolve(X, Y, alphablock[(i * DCTSIZE) + 6], i, 6);
-                    mj_convolve(X, Y, alphablock[(i * DCTSIZE) + 7], i, 7);
-                }
-
-                // y = x1 + y'
-                for(i = 0; i < DCTSIZE2; i += 8) {
-                    coefs_m[i + 0] += (int)Y[i + 0];
-                    coefs_m[i + 1] += (int)Y[i + 1];
-                    coefs_m[i + 2] += (int)Y[i + 2];
-                    coefs_m[i + 3] += (int)Y[i + 3];
-                    coefs_m[i + 4] += (int)Y[i + 4];
-                    coefs_m[i + 5] += (int)Y[i + 5];
-                    coefs_m[i + 6] += (int)Y[i + 6];
-                    coefs_m[i + 7] += (int)Y[i + 7];
-                }
-
-                // quantize
-                for(i = 0; i < DCTSIZE2; i += 8) {
-                    coefs_m[i + 0] /= component_m->quant_table->quantval[i + 0];
-                    coefs_m[i + 1] /= component_m->quant_table->quantval[i + 1];
-                    coefs_m[i + 2] /= component_m->quant_table->quantval[i + 2];
-                    coefs_m[i + 3] /= component_m->quant_table->quantval[i + 3];
-                    coefs_m[i + 4] /= component_m->quant_table->quantval[i + 4];
-                    coefs_m[i + 5] /= component_m->quant_table->quantval[i + 5];
-                    coefs_m[i + 6] /= component_m->quant_table->quantval[i + 6];
-                    coefs_m[i + 7] /= component_m->quant_table->quantval[i + 7];
-                }
-            }
+        // only the blocks of the dropon that are inside of the image are composed
+        mj_clip_blocks(width_offset, cd->image[c].width_in_blocks, component_m->width_in_blocks, &k_start, &k_end);
+        mj_clip_blocks(height_offset, cd->image[c].height_in_blocks, component_m->height_in_blocks, &l_start, &l_end);
+
+        // while streaming, only the rows of the current band are composed
+        mj_get_block_rows(m, c, &band_start, &band_end);
+        if(l_start < (int)band_start - height_offset) {
+            l_start = (int)band_start - height_offset;
+        }
+        if(l_end > (int)band_end - height_offset) {
+            l_end = (int)band_end - height_offset;
+        }
+
+        if(k_start == k_end) {
+            continue;
+        }
+
+        mj_splice_mark(m, c, height_offset + l_start, height_offset + l_end, width_offset + k_start, width_offset + k_end);
+
+        for(l = l_start; l < l_end; l++) {
+            blocks_m = (*cinfo_m->mem->access_virt_barray)((j_common_ptr)cinfo_m, m->coef[c], height_offset + l, 1, TRUE);
+
+            rows.rows[rows.nrows].component = c;
+            rows.rows[rows.nrows].l = l;
+            rows.rows[rows.nrows].k_start = k_start;
+            rows.rows[rows.nrows].k_end = k_end;
+            rows.rows[rows.nrows].blocks = blocks_m[0] + width_offset;
+            rows.nrows++;
         }
     }
 
+    // each row is composed independently, the result doesn't depend on the number of workers
+    mj_pool_run(pool, compose_row, &rows, rows.nrows);
+
+    mj_release(m->arena, rows.rows);
+
     return MJ_OK;
 }
+
+void mj_compose_row_without_mask(void *arg, int task, int worker) {
+    mj_composerows_t *rows = (mj_composerows_t *)arg;
+    mj_composerow_t * row = &rows->rows[task];
+
+    int              k;
+    mj_quanttable_t *qt = &rows->m->quant[row->component];
+    mj_component_t * imagecomp = &rows->cd->image[row->component];
+
+    // copy the values from the dropon into the image
+    for(k = row->k_start; k < row->k_end; k++) {
+        mj_copy_block(row->blocks[k], &imagecomp->blocks[(imagecomp->width_in_blocks * row->l + k) * DCTSIZE2], qt, rows->quantize);
+    }
+
+    return;
+}
+
+void mj_compose_row_with_mask(void *arg, int task, int worker) {
+    mj_composerows_t *rows = (mj_composerows_t *)arg;
+    mj_composerow_t * row = &rows->rows[task];
+
+    int              k, i, n;
+    int              blocktype;
+    mj_quanttable_t *qt = &rows->m->quant[row->component];
+    JCOEFPTR         coefs_m;
+    int              values[DCTSIZE2];
+    float            X[DCTSIZE2], Y[DCTSIZE2], alpha;
+
+    mj_component_t *imagecomp = &rows->cd->image[row->component];
+    mj_component_t *alphacomp = &rows->cd->alpha[row->component];
+    mj_component_t *maskcomp = &rows->cd->mask[row->component];
+    mj_block_t *    imageblock, *alphablock, *maskblock;
+
+    // blend the values from the dropon with the image
+    for(k = row->k_start; k < row->k_end; k++) {
+        n = imagecomp->width_in_blocks * row->l + k;
+
+        coefs_m = row->blocks[k];
+        imageblock = &imagecomp->blocks[n * DCTSIZE2];
+        alphablock = &alphacomp->blocks[n * DCTSIZE2];
+        maskblock = &maskcomp->blocks[n * DCTSIZE2];
+        blocktype = maskcomp->blocktypes[n];
+
+        // the image shines through transparent blocks
+        if(blocktype == MJ_BLOCK_TRANSPARENT) {
+            continue;
+        }
+
+        // opaque blocks replace the blocks of the image
+        if(blocktype == MJ_BLOCK_OPAQUE) {
+            mj_copy_block(coefs_m, imageblock, qt, rows->quantize);
+            continue;
+        }
+
+        // de-quantize
+        mj_dequantize_block(qt, coefs_m, values);
+
+        // x = x0 - x1
+        for(i = 0; i < DCTSIZE2; i += 8) {
+            X[i + 0] = imageblock[i + 0] - values[i + 0];
+            X[i + 1] = imageblock[i + 1] - values[i + 1];
+            X[i + 2] = imageblock[i + 2] - values[i + 2];
+            X[i + 3] = imageblock[i + 3] - values[i + 3];
+            X[i + 4] = imageblock[i + 4] - values[i + 4];
+            X[i + 5] = imageblock[i + 5] - values[i + 5];
+            X[i + 6] = imageblock[i + 6] - values[i + 6];
+            X[i + 7] = imageblock[i + 7] - values[i + 7];
+        }
+
+        // y' = w * x (convolution). if the alpha is the same for all samples,
+        // the convolution is a multiplication with a scalar.
+        if(blocktype == MJ_BLOCK_UNIFORM) {
+            alpha = maskblock[0];
+
+            for(i = 0; i < DCTSIZE2; i += 8) {
+                Y[i + 0] = alpha * X[i + 0];
+                Y[i + 1] = alpha * X[i + 1];
+                Y[i + 2] = alpha * X[i + 2];
+                Y[i + 3] = alpha * X[i + 3];
+                Y[i + 4] = alpha * X[i + 4];
+                Y[i + 5] = alpha * X[i + 5];
+                Y[i + 6] = alpha * X[i + 6];
+                Y[i + 7] = alpha * X[i + 7];
+            }
+        }
+        else {
+            rows->blend(X, Y, alphablock, maskblock);
+        }
+
+        // y = x1 + y'
+        for(i = 0; i < DCTSIZE2; i += 8) {
+            values[i + 0] += (int)Y[i + 0];
+            values[i + 1] += (int)Y[i + 1];
+            values[i + 2] += (int)Y[i + 2];
+            values[i + 3] += (int)Y[i + 3];
+            values[i + 4] += (int)Y[i + 4];
+            values[i + 5] += (int)Y[i + 5];
+            values[i + 6] += (int)Y[i + 6];
+            values[i + 7] += (int)Y[i + 7];
+        }
+
+        // quantize
+        rows->quantize(qt, values, coefs_m);
+    }
+
+    return;
+}
+
+void mj_compose_row_with_mask_fixed(void *arg, int task, int worker) {
+    mj_composerows_t *rows = (mj_composerows_t *)arg;
+    mj_composerow_t * row = &rows->rows[task];
+
+    int              k, i, n, x, alpha;
+    int              blocktype;
+    mj_quanttable_t *qt = &rows->m->quant[row->component];
+    JCOEFPTR         coefs_m;
+    int              values[DCTSIZE2], Y[DCTSIZE2];
+    short            X[DCTSIZE2];
+
+    mj_component_t *imagecomp = &rows->cd->image[row->component];
+    mj_component_t *maskcomp = &rows->cd->mask[row->component];
+    const short *   imageblock, *maskblock;
+
+    // same as mj_compose_row_with_mask(), but with the image in MJ_FIXED_IMAGE_BITS and the mask
+    // in MJ_FIXED_MASK_BITS fixed point
+    for(k = row->k_start; k < row->k_end; k++) {
+        n = imagecomp->width_in_blocks * row->l + k;
+
+        coefs_m = row->blocks[k];
+        imageblock = &imagecomp->fixedblocks[n * DCTSIZE2];
+        maskblock = &maskcomp->fixedblocks[n * DCTSIZE2];
+        blocktype = maskcomp->blocktypes[n];
+
+        if(blocktype == MJ_BLOCK_TRANSPARENT) {
+            continue;
+        }
+
+        // copying doesn't blend, the result is the same as with floats
+        if(blocktype == MJ_BLOCK_OPAQUE) {
+            mj_copy_block(coefs_m, &imagecomp->blocks[n * DCTSIZE2], qt, rows->quantize);
+            continue;
+        }
+
+        // de-quantize and x = x0 - x1
+        mj_dequantize_block(qt, coefs_m, values);
+
+        for(i = 0; i < DCTSIZE2; i++) {
+            x = imageblock[i] - values[i] * (1 << MJ_FIXED_IMAGE_BITS);
+            if(x > SHRT_MAX) {
+                x = SHRT_MAX;
+            }
+            else if(x < SHRT_MIN) {
+                x = SHRT_MIN;
+            }
+
+            X[i] = (short)x;
+        }
+
+        // y' = mask * x, truncated towards zero like the conversion from float
+        if(blocktype == MJ_BLOCK_UNIFORM) {
+            alpha = maskblock[0];
+
+            for(i = 0; i < DCTSIZE2; i++) {
+                Y[i] = (X[i] * alpha) / (1 << (MJ_FIXED_IMAGE_BITS + MJ_FIXED_MASK_BITS));
+            }
+        }
+        else {
+            rows->blend_fixed(X, Y, maskblock);
+        }
+
+        // y = x1 + y' and quantize
+        for(i = 0; i < DCTSIZE2; i++) {
+            values[i] += Y[i];
+        }
+
+        rows->quantize(qt, values, coefs_m);
+    }
+
+    return;
+}
+
+void mj_copy_block(JCOEFPTR coefs, const mj_block_t *block, const mj_quanttable_t *qt, mj_quantize_block_fn quantize) {
+    int i, values[DCTSIZE2];
+
+    // quantize the block of the dropon into the block of the image
+    for(i = 0; i < DCTSIZE2; i += 8) {
+        values[i + 0] = (int)block[i + 0];
+        values[i + 1] = (int)block[i + 1];
+        values[i + 2] = (int)block[i + 2];
+        values[i + 3] = (int)block[i + 3];
+        values[i + 4] = (int)block[i + 4];
+        values[i + 5] = (int)block[i + 5];
+        values[i + 6] = (int)block[i + 6];
+        values[i + 7] = (int)block[i + 7];
+    }
+
+    quantize(qt, values, coefs);
+
+    return;
+}
+
+int mj_compileddropon_is_opaque(mj_compileddropon_t *cd) {
+    int c, i;
+
+    for(c = 0; c < cd->alpha_ncomponents; c++) {
+        for(i = 0; i < cd->mask[c].nblocks; i++) {
+            if(cd->mask[c].blocktypes[i] != MJ_BLOCK_OPAQUE) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+void mj_clip_blocks(int offset, int nblocks, JDIMENSION image_nblocks, int *start, int *end) {
+    // the range [start, end) of dropon blocks that lands inside of the image
+    *start = 0;
+    if(offset < 0) {
+        *start = -offset;
+    }
+
+    *end = nblocks;
+    if(offset + nblocks > (int)image_nblocks) {
+        *end = (int)image_nblocks - offset;
+    }
+
+    if(*end < *start) {
+        *end = *start;
+    }
+
+    return;
+}
@@ -23,9 +23,43 @@
 #ifndef _LIBMODJPEG_COMPOSE_H_
 #define _LIBMODJPEG_COMPOSE_H_
 
+#include "convolve.h"
 #include "libmodjpeg.h"
+#include "pool.h"
+#include "quant.h"
 
-int mj_compose_without_mask(mj_jpeg_t *m, mj_compileddropon_t *cd, int block_x, int block_y);
-int mj_compose_with_mask(mj_jpeg_t *m, mj_compileddropon_t *cd, int block_x, int block_y);
+// a row of blocks of the image that is covered by the dropon
+typedef struct {
+    int       component;
+    int       l;          // the row of blocks in the dropon
+    int       k_start;    // the range of blocks in the dropon that lands inside of the image
+    int       k_end;
+    JBLOCKROW blocks;     // the row of blocks of the image, shifted to the first block of the dropon
+} mj_composerow_t;
+
+typedef struct {
+    mj_jpeg_t *          m;
+    mj_compileddropon_t *cd;
+
+    mj_blend_block_fn       blend;
+    mj_blend_block_fixed_fn blend_fixed;
+    mj_quantize_block_fn    quantize;
+
+    int              nrows;
+    mj_composerow_t *rows;
+} mj_composerows_t;
+
+int  mj_compose_without_mask(mj_jpeg_t *m, mj_compileddropon_t *cd, int block_x, int block_y, mj_pool_t *pool);
+int  mj_compose_with_mask(mj_jpeg_t *m, mj_compileddropon_t *cd, int block_x, int block_y, mj_pool_t *pool);
+int  mj_compose_blocks(mj_jpeg_t *m, mj_compileddropon_t *cd, int block_x, int block_y, mj_pool_t *pool, mj_task_fn compose_row);
+void mj_compose_row_without_mask(void *arg, int task, int worker);
+void mj_compose_row_with_mask(void *arg, int task, int worker);
+void mj_compose_row_with_mask_fixed(void *arg, int task, int worker);
+
+void mj_get_dropon_position(mj_jpeg_t *m, int width, int height, unsigned int align, int offset_x, int offset_y, int *position_x, int *position_y);
+int  mj_compileddropon_matches(mj_jpeg_t *m, mj_compileddropon_t *cd);
+void mj_copy_block(JCOEFPTR coefs, const mj_block_t *block, const mj_quanttable_t *qt, mj_quantize_block_fn quantize);
+int  mj_compileddropon_is_opaque(mj_compileddropon_t *cd);
+void mj_clip_blocks(int offset, int nblocks, JDIMENSION image_nblocks, int *start, int *end);
 
 #endif
\ No newline at end of file
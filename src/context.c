@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "context.h"
+
+#include "arena.h"
+#include "image.h"
+#include "jpeg.h"
+#include "libmodjpeg.h"
+#include "splice.h"
+
+#include <jerror.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int     mj_context_create_compress(mj_context_t *ctx);
+static void    mj_context_reset_tables(mj_context_t *ctx);
+static void    mj_context_init_destination(j_compress_ptr cinfo);
+static boolean mj_context_empty_output_buffer(j_compress_ptr cinfo);
+static void    mj_context_term_destination(j_compress_ptr cinfo);
+
+mj_context_t *mj_create_context(void) {
+    mj_context_t *ctx = (mj_context_t *)calloc(1, sizeof(mj_context_t));
+    if(ctx == NULL) {
+        return NULL;
+    }
+
+    if(mj_context_create_compress(ctx) != MJ_OK) {
+        free(ctx);
+        return NULL;
+    }
+
+    jpeg_std_error(&ctx->djerr.pub);
+    ctx->djerr.pub.error_exit = mj_jpeg_error_exit;
+
+    ctx->src.pub.init_source = mj_jpeg_init_source;
+    ctx->src.pub.fill_input_buffer = mj_jpeg_fill_input_buffer;
+    ctx->src.pub.skip_input_data = mj_jpeg_skip_input_data;
+    ctx->src.pub.resync_to_restart = jpeg_resync_to_restart;
+    ctx->src.pub.term_source = mj_jpeg_term_source;
+
+    ctx->dest.pub.init_destination = mj_context_init_destination;
+    ctx->dest.pub.empty_output_buffer = mj_context_empty_output_buffer;
+    ctx->dest.pub.term_destination = mj_context_term_destination;
+
+    ctx->cinfo.dest = &ctx->dest.pub;
+
+    return ctx;
+}
+
+void mj_free_context(mj_context_t *ctx) {
+    if(ctx == NULL) {
+        return;
+    }
+
+    jpeg_destroy_compress(&ctx->cinfo);
+
+    if(ctx->dest.buf != NULL) {
+        free(ctx->dest.buf);
+    }
+
+    free(ctx);
+
+    return;
+}
+
+int mj_read_jpeg_from_memory_context(mj_jpeg_t *m, const unsigned char *memory, size_t len, size_t max_pixel, mj_context_t *ctx) {
+    if(m == NULL || ctx == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    if(memory == NULL || len == 0) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    if(setjmp(ctx->djerr.setjmp_buffer)) {
+        mj_free_jpeg(m);
+        return MJ_ERR_DECODE_JPEG;
+    }
+
+    // the decompress object of the previous image that has been read with this context is reused if the arena is the same
+    if(m->cinfo.mem != NULL && m->cinfo.src == &ctx->src.pub && m->cinfo.client_data == m->arena) {
+        jpeg_abort_decompress(&m->cinfo);
+        mj_splice_free(m);
+
+        m->coef = NULL;
+        m->band_start = 0;
+        m->band_end = 0;
+    }
+    else {
+        mj_free_jpeg(m);
+
+        m->cinfo.err = &ctx->djerr.pub;
+        m->cinfo.client_data = NULL;
+        jpeg_create_decompress(&m->cinfo);
+
+        // the decompress object outlives the job of the arena, only the coefficients of each image come from the arena
+        mj_arena_attach_arrays(m->arena, (j_common_ptr)&m->cinfo);
+
+        m->cinfo.src = &ctx->src.pub;
+    }
+
+    ctx->src.buf = (JOCTET *)memory;
+    ctx->src.size = len;
+
+    int rv = mj_read_jpeg(m, memory, len, max_pixel);
+    if(rv != MJ_OK) {
+        mj_free_jpeg(m);
+    }
+
+    return rv;
+}
+
+int mj_write_jpeg_to_memory_context(mj_jpeg_t *m, const unsigned char **memory, size_t *len, int options, mj_context_t *ctx) {
+    if(m == NULL || ctx == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    unsigned char *spliced = NULL;
+    size_t         spliced_len = 0;
+
+    // copy the restart segments that haven't been modified, otherwise encode the whole image
+    if((options & MJ_OPTION_SPLICE) != 0 && mj_splice_jpeg(m, &spliced, &spliced_len, options) != MJ_OK) {
+        spliced = NULL;
+    }
+
+    if(setjmp(ctx->jerr.setjmp_buffer)) {
+        // the compress object is ready for the next image
+        jpeg_abort_compress(&ctx->cinfo);
+        if(spliced != NULL) {
+            free(spliced);
+        }
+
+        return MJ_ERR_ENCODE_JPEG;
+    }
+
+    mj_context_reset_tables(ctx);
+    mj_write_jpeg(m, &ctx->cinfo, spliced, spliced_len, options);
+
+    if(spliced != NULL) {
+        free(spliced);
+    }
+
+    *memory = ctx->dest.buf;
+    *len = ctx->dest.len;
+
+    return MJ_OK;
+}
+
+static int mj_context_create_compress(mj_context_t *ctx) {
+    int i;
+
+    ctx->cinfo.err = jpeg_std_error(&ctx->jerr.pub);
+    ctx->jerr.pub.error_exit = mj_jpeg_error_exit;
+    if(setjmp(ctx->jerr.setjmp_buffer)) {
+        jpeg_destroy_compress(&ctx->cinfo);
+        return MJ_ERR_MEMORY;
+    }
+
+    jpeg_create_compress(&ctx->cinfo);
+
+    // keep the standard Huffman tables
+    ctx->cinfo.in_color_space = JCS_YCbCr;
+    ctx->cinfo.input_components = 3;
+    jpeg_set_defaults(&ctx->cinfo);
+
+    for(i = 0; i < NUM_HUFF_TBLS; i++) {
+        if(ctx->cinfo.dc_huff_tbl_ptrs[i] != NULL) {
+            ctx->dc_huff_tbl[i] = *ctx->cinfo.dc_huff_tbl_ptrs[i];
+        }
+
+        if(ctx->cinfo.ac_huff_tbl_ptrs[i] != NULL) {
+            ctx->ac_huff_tbl[i] = *ctx->cinfo.ac_huff_tbl_ptrs[i];
+        }
+    }
+
+    return MJ_OK;
+}
+
+static void mj_context_reset_tables(mj_context_t *ctx) {
+    int i;
+
+    for(i = 0; i < NUM_HUFF_TBLS; i++) {
+        if(ctx->cinfo.dc_huff_tbl_ptrs[i] != NULL) {
+            *ctx->cinfo.dc_huff_tbl_ptrs[i] = ctx->dc_huff_tbl[i];
+        }
+
+        if(ctx->cinfo.ac_huff_tbl_ptrs[i] != NULL) {
+            *ctx->cinfo.ac_huff_tbl_ptrs[i] = ctx->ac_huff_tbl[i];
+        }
+    }
+
+    return;
+}
+
+static void mj_context_init_destination(j_compress_ptr cinfo) {
+    struct mj_context_dest_mgr *dest = (struct mj_context_dest_mgr *)cinfo->dest;
+
+    if(dest->buf == NULL) {
+        dest->buf = (JOCTET *)malloc(MJ_DESTBUFFER_CHUNKSIZE * sizeof(JOCTET));
+        if(dest->buf == NULL) {
+            ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+        }
+        dest->size = MJ_DESTBUFFER_CHUNKSIZE;
+    }
+
+    dest->len = 0;
+
+    dest->pub.next_output_byte = dest->buf;
+    dest->pub.free_in_buffer = dest->size;
+
+    return;
+}
+
+static boolean mj_context_empty_output_buffer(j_compress_ptr cinfo) {
+    struct mj_context_dest_mgr *dest = (struct mj_context_dest_mgr *)cinfo->dest;
+    JOCTET *                    ret;
+
+    // the buffer only grows, after a few images it fits all of them
+    ret = (JOCTET *)realloc(dest->buf, 2 * dest->size * sizeof(JOCTET));
+    if(ret == NULL) {
+        ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+    }
+    dest->buf = ret;
+
+    dest->pub.next_output_byte = dest->buf + dest->size;
+    dest->pub.free_in_buffer = dest->size;
+
+    dest->size *= 2;
+
+    return TRUE;
+}
+
+static void mj_context_term_destination(j_compress_ptr cinfo) {
+    struct mj_context_dest_mgr *dest = (struct mj_context_dest_mgr *)cinfo->dest;
+
+    dest->len = dest->size - dest->pub.free_in_buffer;
+
+    return;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_CONTEXT_H_
+#define _LIBMODJPEG_CONTEXT_H_
+
+#include "jpeg.h"
+#include "libmodjpeg.h"
+
+// a destination that keeps its buffer for the next JPEG
+struct mj_context_dest_mgr {
+    struct jpeg_destination_mgr pub;
+
+    JOCTET *buf;
+    size_t  size;    // the size of the buffer
+    size_t  len;     // the length of the last JPEG
+};
+
+struct mj_context {
+    struct jpeg_compress_struct cinfo;
+    struct mj_jpeg_error_mgr    jerr;     // for the compress object
+    struct mj_jpeg_error_mgr    djerr;    // for the decompress objects of the images read with the context
+
+    struct mj_jpeg_src_mgr     src;
+    struct mj_context_dest_mgr dest;
+
+    // libjpeg only sets the standard Huffman tables if there are none yet, i.e. the tables of an
+    // optimized JPEG would stay for the next one
+    JHUFF_TBL dc_huff_tbl[NUM_HUFF_TBLS];
+    JHUFF_TBL ac_huff_tbl[NUM_HUFF_TBLS];
+};
+
+#endif
@@ -38,11 +38,18 @@ static struct option longopts[] = {
     { "luminance",   required_argument, NULL, 'y' },
     { "tintblue",    required_argument, NULL, 'b' },
     { "tintred",     required_argument, NULL, 'r' },
+    { "contrast",    required_argument, NULL, 'c' },
+    { "saturation",  required_argument, NULL, 's' },
+    { "scale",       required_argument, NULL, 'z' },
+    { "crop",        required_argument, NULL, 'C' },
     { "pixelate",    no_argument,       NULL, 'x' },
     { "grayscale",   no_argument,       NULL, 'g' },
     { "progressive", no_argument,       NULL, 'P' },
     { "optimize",    no_argument,       NULL, 'O' },
     { "arithmetric", no_argument,       NULL, 'A' },
+    { "splice",      no_argument,       NULL, 'S' },
+    { "gray",        no_argument,       NULL, 'G' },
+    { "markers",     required_argument, NULL, 'k' },
     { "help",        no_argument,       NULL, 'h' },
     { NULL,          0,                 NULL,  0  }
 };
@@ -50,9 +57,9 @@ static struct option longopts[] = {
 void help(void);
 
 int main(int argc, char *argv[]) {
-    int c, t, position = MJ_ALIGN_TOP | MJ_ALIGN_LEFT, offset_x = 0, offset_y = 0, options = 0, rv = MJ_OK;
+    int c, t, crop[4], position = MJ_ALIGN_TOP | MJ_ALIGN_LEFT, offset_x = 0, offset_y = 0, options = 0, rv = MJ_OK;
     char *str;
-    mj_jpeg_t m;
+    mj_jpeg_t m, scaled;
     mj_dropon_t d;
 
     mj_init_jpeg(&m);
@@ -60,7 +67,7 @@ int main(int argc, char *argv[]) {
 
     opterr = 1;
 
-    while((c = getopt_long(argc, argv, ":i: :o: :d: :p: :m: :y: :b: :r: xgPOAh", longopts, NULL)) != -1) {
+    while((c = getopt_long(argc, argv, ":i: :o: :d: :p: :m: :y: :b: :r: :c: :s: :z: :C: :k: xgPOASGh", longopts, NULL)) != -1) {
         switch(c) {
             case 'i':
                 if(mj_read_jpeg_from_file(&m, optarg, 0) != MJ_OK) {
@@ -143,6 +150,42 @@ int main(int argc, char *argv[]) {
             case 'r':
                 t = (int)strtol(optarg, NULL, 10);
                 mj_effect_tint(&m, 0, t);
+                break;
+            case 'c':
+                t = (int)strtol(optarg, NULL, 10);
+                mj_effect_contrast(&m, t);
+                break;
+            case 's':
+                t = (int)strtol(optarg, NULL, 10);
+                mj_effect_saturation(&m, t);
+                break;
+            case 'z':
+                t = (int)strtol(optarg, NULL, 10);
+
+                mj_init_jpeg(&scaled);
+                scaled.markers = m.markers;
+
+                if(mj_downscale(&scaled, &m, t) != MJ_OK) {
+                    fprintf(stderr, "Can't scale the image by 1/%d\n", t);
+                    exit(1);
+                }
+
+                // the scaled image replaces the image
+                mj_free_jpeg(&m);
+                m = scaled;
+
+                break;
+            case 'C':
+                if(sscanf(optarg, "%d,%d,%d,%d", &crop[0], &crop[1], &crop[2], &crop[3]) != 4) {
+                    fprintf(stderr, "Invalid crop, use --help for more details\n");
+                    exit(1);
+                }
+
+                if(mj_crop(&m, crop[0], crop[1], crop[2], crop[3]) != MJ_OK) {
+                    fprintf(stderr, "Can't crop the image\n");
+                    exit(1);
+                }
+
                 break;
             case 'x':
                 mj_effect_pixelate(&m);
@@ -159,6 +202,28 @@ int main(int argc, char *argv[]) {
             case 'A':
                 options |= MJ_OPTION_ARITHMETRIC;
                 break;
+            case 'S':
+                options |= MJ_OPTION_SPLICE;
+                m.splice = 1;
+                break;
+            case 'G':
+                options |= MJ_OPTION_GRAYSCALE;
+                break;
+            case 'k':
+                if(strcmp(optarg, "all") == 0) {
+                    m.markers = MJ_MARKERS_ALL;
+                }
+                else if(strcmp(optarg, "icc") == 0) {
+                    m.markers = MJ_MARKERS_ICC;
+                }
+                else if(strcmp(optarg, "none") == 0) {
+                    m.markers = MJ_MARKERS_NONE;
+                }
+                else {
+                    fprintf(stderr, "Unknown marker policy '%s', use --help for more details\n", optarg);
+                    exit(1);
+                }
+                break;
             case 'h':
                 help();
                 exit(0);
@@ -222,6 +287,25 @@ void help(void) {
     fprintf(stderr, "\t\tvalue to tint the image red.\n");
     fprintf(stderr, "\n");
 
+    fprintf(stderr, "\t--contrast, -c value\n");
+    fprintf(stderr, "\t\tChanges the contrast of the image by the value in percent. Use a negative value\n");
+    fprintf(stderr, "\t\tto reduce the contrast, and a positive value to increase it.\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "\t--saturation, -s value\n");
+    fprintf(stderr, "\t\tChanges the saturation of the image by the value in percent. Use a negative value\n");
+    fprintf(stderr, "\t\tto reduce the saturation, and a positive value to increase it.\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "\t--scale, -z 2|4|8\n");
+    fprintf(stderr, "\t\tScale the image down to 1/2, 1/4, or 1/8 of its size.\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "\t--crop, -C x,y,width,height\n");
+    fprintf(stderr, "\t\tCrop the image to the rectangle in pixels. The left and top edges are moved to the\n");
+    fprintf(stderr, "\t\tprevious multiple of the MCU size, such that the image is cropped without loss.\n");
+    fprintf(stderr, "\n");
+
     fprintf(stderr, "\t--pixelate, -x\n");
     fprintf(stderr, "\t\tPixelate the image into 8x8 blocks.\n");
     fprintf(stderr, "\n");
@@ -242,6 +326,20 @@ void help(void) {
     fprintf(stderr, "\t\tUse arithmetric coding instead of Huffman coding.\n");
     fprintf(stderr, "\n");
 
+    fprintf(stderr, "\t--splice, -S\n");
+    fprintf(stderr, "\t\tCopy the unmodified restart segments of the input image.\n");
+    fprintf(stderr, "\t\tGive it before the input image.\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "\t--gray, -G\n");
+    fprintf(stderr, "\t\tStore only the luminance of the output image as a grayscale JPEG with one component.\n");
+    fprintf(stderr, "\n");
+
+    fprintf(stderr, "\t--markers, -k all|icc|none\n");
+    fprintf(stderr, "\t\tThe markers of the input image to keep. icc keeps the ICC profile and the orientation.\n");
+    fprintf(stderr, "\t\tGive it before the input image. Default: all\n");
+    fprintf(stderr, "\n");
+
     fprintf(stderr, "Examples:\n");
     fprintf(stderr, "\n");
 
@@ -249,6 +347,10 @@ void help(void) {
     fprintf(stderr, "\t\tmodjpeg --input in.jpg --position tr --dropon logo.jpg --output out.jpg\n");
     fprintf(stderr, "\n");
 
+    fprintf(stderr, "\tMake a thumbnail of a quarter of the size with a logo in the top right corner:\n");
+    fprintf(stderr, "\t\tmodjpeg --input in.jpg --scale 4 --position tr --dropon logo.jpg --output thumb.jpg\n");
+    fprintf(stderr, "\n");
+
     fprintf(stderr, "\tPixelate the image and then place a logo in the top right corner:\n");
     fprintf(stderr, "\t\tmodjpeg --input in.jpg --pixelate --position tr --dropon logo.jpg --output out.jpg\n");
     fprintf(stderr, "\n");
@@ -22,11 +22,21 @@
 
 #include "convolve.h"
 
+#include "dct.h"
 #include "libmodjpeg.h"
 
 #include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
 
-void mj_convolve(mj_block_t *x, mj_block_t *y, float w, int k, int l) {
+static pthread_once_t          mj_blend_block_once = PTHREAD_ONCE_INIT;
+static mj_blend_block_fn       mj_blend_block = mj_blend_block_reference;
+static mj_blend_block_fixed_fn mj_blend_block_fixed = mj_blend_block_fixed_reference;
+
+static void mj_init_blend_block(void);
+
+void mj_convolve(const mj_block_t *x, mj_block_t *y, float w, int k, int l) {
     float z[64] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
     if(w == 0.0) {
@@ -1097,3 +1107,157 @@ void mj_convolve(mj_block_t *x, mj_block_t *y, float w, int k, int l) {
 
     return;
 }
+
+void mj_blend_block_reference(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask) {
+    int i;
+
+    memset(y, 0, DCTSIZE2 * sizeof(mj_block_t));
+
+    // y = w * x (convolution)
+    for(i = 0; i < DCTSIZE; i++) {
+        mj_convolve(x, y, weights[(i * DCTSIZE) + 0], i, 0);
+        mj_convolve(x, y, weights[(i * DCTSIZE) + 1], i, 1);
+        mj_convolve(x, y, weights[(i * DCTSIZE) + 2], i, 2);
+        mj_convolve(x, y, weights[(i * DCTSIZE) + 3], i, 3);
+        mj_convolve(x, y, weights[(i * DCTSIZE) + 4], i, 4);
+        mj_convolve(x, y, weights[(i * DCTSIZE) + 5], i, 5);
+        mj_convolve(x, y, weights[(i * DCTSIZE) + 6], i, 6);
+        mj_convolve(x, y, weights[(i * DCTSIZE) + 7], i, 7);
+    }
+
+    return;
+}
+
+void mj_blend_block_fixed_reference(const short *x, int *y, const short *mask) {
+    short p[DCTSIZE2], s[DCTSIZE2];
+    int   i;
+
+    // s = T' * x * T, from MJ_FIXED_IMAGE_BITS to MJ_FIXED_PASS_BITS
+    mj_matmul_fixed(x, &mj_dct_matrix_fixed[0][0], p, MJ_FIXED_IMAGE_BITS + MJ_FIXED_DCT_BITS - MJ_FIXED_PASS_BITS);
+    mj_matmul_fixed(&mj_idct_matrix_fixed[0][0], p, s, MJ_FIXED_DCT_BITS);
+
+    for(i = 0; i < DCTSIZE2; i++) {
+        s[i] = mj_descale_fixed((int)s[i] * mask[i], MJ_FIXED_MASK_BITS);
+    }
+
+    // y = T * s * T'
+    mj_matmul_fixed(s, &mj_idct_matrix_fixed[0][0], p, MJ_FIXED_DCT_BITS);
+
+    int r, c, j, acc;
+
+    for(r = 0; r < DCTSIZE; r++) {
+        for(c = 0; c < DCTSIZE; c++) {
+            acc = 0;
+            for(j = 0; j < DCTSIZE; j++) {
+                acc += (int)mj_dct_matrix_fixed[r][j] * p[j * DCTSIZE + c];
+            }
+
+            y[r * DCTSIZE + c] = acc / (1 << (MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS));
+        }
+    }
+
+    return;
+}
+
+void mj_matmul_fixed(const short *a, const short *b, short *c, int shift) {
+    int r, col, j, acc;
+
+    // c = a * b, rounded and shifted by shift bits
+    for(r = 0; r < DCTSIZE; r++) {
+        for(col = 0; col < DCTSIZE; col++) {
+            acc = 0;
+            for(j = 0; j < DCTSIZE; j++) {
+                acc += (int)a[r * DCTSIZE + j] * b[j * DCTSIZE + col];
+            }
+
+            c[r * DCTSIZE + col] = mj_descale_fixed(acc, shift);
+        }
+    }
+
+    return;
+}
+
+short mj_descale_fixed(int x, int shift) {
+    // round, shift, and saturate to 16 bits. the SIMD implementations do exactly the same.
+    x = (x + (1 << (shift - 1))) >> shift;
+
+    if(x < -32768) {
+        return -32768;
+    }
+    else if(x > 32767) {
+        return 32767;
+    }
+
+    return (short)x;
+}
+
+static void mj_init_blend_block(void) {
+    // pick the fastest implementation the CPU supports. the environment variable MODJPEG_SIMD can be set to
+    // "none", "sse2", "avx2", "avx512", or "neon" in order to force an implementation, if it is supported.
+    const char *simd = getenv("MODJPEG_SIMD");
+
+    if(simd != NULL && strcmp(simd, "none") == 0) {
+        return;
+    }
+
+#if defined(MJ_HAVE_X86_SIMD)
+    __builtin_cpu_init();
+
+    int have_sse2 = __builtin_cpu_supports("sse2");
+    int have_avx2 = __builtin_cpu_supports("avx2");
+    int have_fma = __builtin_cpu_supports("fma");
+    int have_avx512 = __builtin_cpu_supports("avx512f");
+
+    // with 8 floats per row, AVX2 keeps more independent rows in flight than AVX-512 and is
+    // at least as fast on most CPUs. AVX-512 is only used by default if AVX2 is missing.
+    int use_avx512 = have_avx512 && !(have_avx2 && have_fma);
+
+    if(simd != NULL) {
+        if(strcmp(simd, "avx512") == 0 && have_avx512) {
+            use_avx512 = 1;
+        }
+        else if(strcmp(simd, "avx2") == 0 && have_avx2 && have_fma) {
+            use_avx512 = 0;
+        }
+        else if(strcmp(simd, "sse2") == 0 && have_sse2) {
+            use_avx512 = 0;
+            have_avx2 = 0;
+        }
+    }
+
+    if(use_avx512) {
+        mj_blend_block = mj_blend_block_avx512;
+    }
+    else if(have_avx2 && have_fma) {
+        mj_blend_block = mj_blend_block_avx2;
+    }
+    else if(have_sse2) {
+        mj_blend_block = mj_blend_block_sse2;
+    }
+
+    // there's no AVX-512 variant of the fixed point blending
+    if(have_avx2) {
+        mj_blend_block_fixed = mj_blend_block_fixed_avx2;
+    }
+    else if(have_sse2) {
+        mj_blend_block_fixed = mj_blend_block_fixed_sse2;
+    }
+#elif defined(MJ_HAVE_NEON)
+    mj_blend_block = mj_blend_block_neon;
+    mj_blend_block_fixed = mj_blend_block_fixed_neon;
+#endif
+
+    return;
+}
+
+mj_blend_block_fn mj_get_blend_block(void) {
+    pthread_once(&mj_blend_block_once, mj_init_blend_block);
+
+    return mj_blend_block;
+}
+
+mj_blend_block_fixed_fn mj_get_blend_block_fixed(void) {
+    pthread_once(&mj_blend_block_once, mj_init_blend_block);
+
+    return mj_blend_block_fixed;
+}
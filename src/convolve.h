@@ -25,6 +25,43 @@
 
 #include "libmodjpeg.h"
 
-void mj_convolve(mj_block_t *x, mj_block_t *y, float w, int k, int l);
+// blends the difference x of two blocks with the alpha of the dropon, i.e. y = FDCT(mask * IDCT(x)). weights
+// are the DCT coefficients of the alpha as used by mj_convolve(), mask is the alpha in the spatial domain.
+typedef void (*mj_blend_block_fn)(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask);
+
+// the same in fixed point. x has MJ_FIXED_IMAGE_BITS and mask MJ_FIXED_MASK_BITS fractional bits. y gets
+// the integer part, truncated towards zero like the float path. the intermediate results are kept in 16 bits
+// with MJ_FIXED_PASS_BITS fractional bits, products are accumulated in 32 bits. all implementations give
+// the same result.
+typedef void (*mj_blend_block_fixed_fn)(const short *x, int *y, const short *mask);
+
+#define MJ_FIXED_IMAGE_BITS 2
+#define MJ_FIXED_MASK_BITS  14
+#define MJ_FIXED_PASS_BITS  4
+
+void mj_convolve(const mj_block_t *x, mj_block_t *y, float w, int k, int l);
+
+void              mj_blend_block_reference(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask);
+mj_blend_block_fn mj_get_blend_block(void);
+
+void                    mj_blend_block_fixed_reference(const short *x, int *y, const short *mask);
+void                    mj_matmul_fixed(const short *a, const short *b, short *c, int shift);
+short                   mj_descale_fixed(int x, int shift);
+mj_blend_block_fixed_fn mj_get_blend_block_fixed(void);
+
+#if defined(__x86_64__) || defined(__i386__)
+#    define MJ_HAVE_X86_SIMD
+void mj_blend_block_sse2(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask);
+void mj_blend_block_avx2(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask);
+void mj_blend_block_avx512(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask);
+void mj_blend_block_fixed_sse2(const short *x, int *y, const short *mask);
+void mj_blend_block_fixed_avx2(const short *x, int *y, const short *mask);
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#    define MJ_HAVE_NEON
+void mj_blend_block_neon(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask);
+void mj_blend_block_fixed_neon(const short *x, int *y, const short *mask);
+#endif
 
 #endif
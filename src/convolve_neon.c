@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "convolve.h"
+
+#include "dct.h"
+#include "libmodjpeg.h"
+
+#if defined(MJ_HAVE_NEON)
+
+#    include <arm_neon.h>
+
+#    if defined(__aarch64__)
+#        define mj_vmla_n_f32(a, b, n) vfmaq_n_f32((a), (b), (n))
+#    else
+#        define mj_vmla_n_f32(a, b, n) vmlaq_n_f32((a), (b), (n))
+#    endif
+
+// same as the x86 kernels: y = T * (mask * (T' * x * T)) * T' with four 8x8 matrix products, c = a * b.
+static inline void mj_matmul_neon(const float *a, const float *b, float *c) {
+    int         i, j;
+    float32x4_t lo[DCTSIZE], hi[DCTSIZE], rlo, rhi;
+
+    for(j = 0; j < DCTSIZE; j++) {
+        lo[j] = vld1q_f32(b + j * DCTSIZE);
+        hi[j] = vld1q_f32(b + j * DCTSIZE + 4);
+    }
+
+    for(i = 0; i < DCTSIZE; i++, a += DCTSIZE) {
+        rlo = vmulq_n_f32(lo[0], a[0]);
+        rhi = vmulq_n_f32(hi[0], a[0]);
+
+        for(j = 1; j < DCTSIZE; j++) {
+            rlo = mj_vmla_n_f32(rlo, lo[j], a[j]);
+            rhi = mj_vmla_n_f32(rhi, hi[j], a[j]);
+        }
+
+        vst1q_f32(c + i * DCTSIZE, rlo);
+        vst1q_f32(c + i * DCTSIZE + 4, rhi);
+    }
+
+    return;
+}
+
+void mj_blend_block_neon(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask) {
+    int   i;
+    float s[DCTSIZE2], t[DCTSIZE2];
+
+    mj_matmul_neon(x, &mj_dct_matrix[0][0], t);
+    mj_matmul_neon(&mj_idct_matrix[0][0], t, s);
+
+    for(i = 0; i < DCTSIZE2; i += 4) {
+        vst1q_f32(s + i, vmulq_f32(vld1q_f32(s + i), vld1q_f32(mask + i)));
+    }
+
+    mj_matmul_neon(s, &mj_idct_matrix[0][0], t);
+    mj_matmul_neon(&mj_dct_matrix[0][0], t, y);
+
+    return;
+}
+
+// fixed point variant of mj_matmul_neon with the same rounding and saturation as mj_descale_fixed()
+static inline void mj_matmul_fixed_neon(const short *a, const short *b, short *c, int shift) {
+    int       i, j;
+    int16x4_t lo[DCTSIZE], hi[DCTSIZE];
+    int32x4_t rlo, rhi;
+
+    const int32x4_t count = vdupq_n_s32(-shift);
+
+    for(j = 0; j < DCTSIZE; j++) {
+        lo[j] = vld1_s16(b + j * DCTSIZE);
+        hi[j] = vld1_s16(b + j * DCTSIZE + 4);
+    }
+
+    for(i = 0; i < DCTSIZE; i++, a += DCTSIZE) {
+        rlo = vmull_n_s16(lo[0], a[0]);
+        rhi = vmull_n_s16(hi[0], a[0]);
+
+        for(j = 1; j < DCTSIZE; j++) {
+            rlo = vmlal_n_s16(rlo, lo[j], a[j]);
+            rhi = vmlal_n_s16(rhi, hi[j], a[j]);
+        }
+
+        vst1_s16(c + i * DCTSIZE, vqmovn_s32(vrshlq_s32(rlo, count)));
+        vst1_s16(c + i * DCTSIZE + 4, vqmovn_s32(vrshlq_s32(rhi, count)));
+    }
+
+    return;
+}
+
+void mj_blend_block_fixed_neon(const short *x, int *y, const short *mask) {
+    int       i, j;
+    short     p[DCTSIZE2], s[DCTSIZE2];
+    int16x4_t lo[DCTSIZE], hi[DCTSIZE];
+    int32x4_t rlo, rhi;
+
+    mj_matmul_fixed_neon(x, &mj_dct_matrix_fixed[0][0], p, MJ_FIXED_IMAGE_BITS + MJ_FIXED_DCT_BITS - MJ_FIXED_PASS_BITS);
+    mj_matmul_fixed_neon(&mj_idct_matrix_fixed[0][0], p, s, MJ_FIXED_DCT_BITS);
+
+    for(i = 0; i < DCTSIZE2; i += 4) {
+        rlo = vmull_s16(vld1_s16(s + i), vld1_s16(mask + i));
+        vst1_s16(s + i, vqmovn_s32(vrshrq_n_s32(rlo, MJ_FIXED_MASK_BITS)));
+    }
+
+    mj_matmul_fixed_neon(s, &mj_idct_matrix_fixed[0][0], p, MJ_FIXED_DCT_BITS);
+
+    // y = T * p, truncated towards zero
+    for(j = 0; j < DCTSIZE; j++) {
+        lo[j] = vld1_s16(p + j * DCTSIZE);
+        hi[j] = vld1_s16(p + j * DCTSIZE + 4);
+    }
+
+    for(i = 0; i < DCTSIZE; i++) {
+        rlo = vmull_n_s16(lo[0], mj_dct_matrix_fixed[i][0]);
+        rhi = vmull_n_s16(hi[0], mj_dct_matrix_fixed[i][0]);
+
+        for(j = 1; j < DCTSIZE; j++) {
+            rlo = vmlal_n_s16(rlo, lo[j], mj_dct_matrix_fixed[i][j]);
+            rhi = vmlal_n_s16(rhi, hi[j], mj_dct_matrix_fixed[i][j]);
+        }
+
+        rlo = vaddq_s32(rlo, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(rlo, 31)), 32 - (MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS))));
+        rhi = vaddq_s32(rhi, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(vshrq_n_s32(rhi, 31)), 32 - (MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS))));
+
+        vst1q_s32(y + i * DCTSIZE, vshrq_n_s32(rlo, MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS));
+        vst1q_s32(y + i * DCTSIZE + 4, vshrq_n_s32(rhi, MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS));
+    }
+
+    return;
+}
+
+#endif
@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "convolve.h"
+
+#include "dct.h"
+#include "libmodjpeg.h"
+
+#if defined(MJ_HAVE_X86_SIMD)
+
+#    include <immintrin.h>
+#    include <string.h>
+
+// all kernels compute y = T * (mask * (T' * x * T)) * T' with four 8x8 matrix products, c = a * b. each row
+// of c is the sum of the rows of b, weighted with the elements of the corresponding row of a.
+
+__attribute__((target("sse2"))) static inline void mj_matmul_sse2(const float *a, const float *b, float *c) {
+    int    i, j;
+    __m128 lo, hi, s;
+
+    for(i = 0; i < DCTSIZE; i++) {
+        s = _mm_set1_ps(a[i * DCTSIZE]);
+        lo = _mm_mul_ps(s, _mm_loadu_ps(b));
+        hi = _mm_mul_ps(s, _mm_loadu_ps(b + 4));
+
+        for(j = 1; j < DCTSIZE; j++) {
+            s = _mm_set1_ps(a[i * DCTSIZE + j]);
+            lo = _mm_add_ps(lo, _mm_mul_ps(s, _mm_loadu_ps(b + j * DCTSIZE)));
+            hi = _mm_add_ps(hi, _mm_mul_ps(s, _mm_loadu_ps(b + j * DCTSIZE + 4)));
+        }
+
+        _mm_storeu_ps(c + i * DCTSIZE, lo);
+        _mm_storeu_ps(c + i * DCTSIZE + 4, hi);
+    }
+
+    return;
+}
+
+__attribute__((target("sse2"))) void mj_blend_block_sse2(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask) {
+    int   i;
+    float s[DCTSIZE2], t[DCTSIZE2];
+
+    mj_matmul_sse2(x, &mj_dct_matrix[0][0], t);
+    mj_matmul_sse2(&mj_idct_matrix[0][0], t, s);
+
+    for(i = 0; i < DCTSIZE2; i += 4) {
+        _mm_storeu_ps(s + i, _mm_mul_ps(_mm_loadu_ps(s + i), _mm_loadu_ps(mask + i)));
+    }
+
+    mj_matmul_sse2(s, &mj_idct_matrix[0][0], t);
+    mj_matmul_sse2(&mj_dct_matrix[0][0], t, y);
+
+    return;
+}
+
+__attribute__((target("avx2,fma"))) static inline void mj_matmul_avx2(const float *a, const float *b, float *c) {
+    int    i;
+    __m256 b0, b1, b2, b3, b4, b5, b6, b7, r;
+
+    b0 = _mm256_loadu_ps(b + 0 * DCTSIZE);
+    b1 = _mm256_loadu_ps(b + 1 * DCTSIZE);
+    b2 = _mm256_loadu_ps(b + 2 * DCTSIZE);
+    b3 = _mm256_loadu_ps(b + 3 * DCTSIZE);
+    b4 = _mm256_loadu_ps(b + 4 * DCTSIZE);
+    b5 = _mm256_loadu_ps(b + 5 * DCTSIZE);
+    b6 = _mm256_loadu_ps(b + 6 * DCTSIZE);
+    b7 = _mm256_loadu_ps(b + 7 * DCTSIZE);
+
+    for(i = 0; i < DCTSIZE; i++, a += DCTSIZE) {
+        r = _mm256_mul_ps(_mm256_broadcast_ss(a + 0), b0);
+        r = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 1), b1, r);
+        r = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 2), b2, r);
+        r = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 3), b3, r);
+        r = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 4), b4, r);
+        r = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 5), b5, r);
+        r = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 6), b6, r);
+        r = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 7), b7, r);
+
+        _mm256_storeu_ps(c + i * DCTSIZE, r);
+    }
+
+    return;
+}
+
+__attribute__((target("avx2,fma"))) void mj_blend_block_avx2(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask) {
+    int   i;
+    float s[DCTSIZE2], t[DCTSIZE2];
+
+    mj_matmul_avx2(x, &mj_dct_matrix[0][0], t);
+    mj_matmul_avx2(&mj_idct_matrix[0][0], t, s);
+
+    for(i = 0; i < DCTSIZE2; i += 8) {
+        _mm256_storeu_ps(s + i, _mm256_mul_ps(_mm256_loadu_ps(s + i), _mm256_loadu_ps(mask + i)));
+    }
+
+    mj_matmul_avx2(s, &mj_idct_matrix[0][0], t);
+    mj_matmul_avx2(&mj_dct_matrix[0][0], t, y);
+
+    return;
+}
+
+// two rows of c at a time. the rows of b are duplicated into both halves of a register and the elements
+// of two rows of a are spread over the corresponding halves.
+__attribute__((target("avx512f"))) static inline void mj_matmul_avx512(const float *a, const float *b, float *c) {
+    int     i, j;
+    __m512  bj[DCTSIZE], ai, r, q;
+    __m512i idx[DCTSIZE];
+
+    const __m512i half = _mm512_set_epi32(8, 8, 8, 8, 8, 8, 8, 8, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    for(j = 0; j < DCTSIZE; j++) {
+        bj[j] = _mm512_castps256_ps512(_mm256_loadu_ps(b + j * DCTSIZE));
+        bj[j] = _mm512_shuffle_f32x4(bj[j], bj[j], 0x44);
+        idx[j] = _mm512_add_epi32(_mm512_set1_epi32(j), half);
+    }
+
+    for(i = 0; i < DCTSIZE; i += 2) {
+        ai = _mm512_loadu_ps(a + i * DCTSIZE);
+
+        // two independent sums to shorten the dependency chains
+        r = _mm512_mul_ps(_mm512_permutexvar_ps(idx[0], ai), bj[0]);
+        q = _mm512_mul_ps(_mm512_permutexvar_ps(idx[1], ai), bj[1]);
+        r = _mm512_fmadd_ps(_mm512_permutexvar_ps(idx[2], ai), bj[2], r);
+        q = _mm512_fmadd_ps(_mm512_permutexvar_ps(idx[3], ai), bj[3], q);
+        r = _mm512_fmadd_ps(_mm512_permutexvar_ps(idx[4], ai), bj[4], r);
+        q = _mm512_fmadd_ps(_mm512_permutexvar_ps(idx[5], ai), bj[5], q);
+        r = _mm512_fmadd_ps(_mm512_permutexvar_ps(idx[6], ai), bj[6], r);
+        q = _mm512_fmadd_ps(_mm512_permutexvar_ps(idx[7], ai), bj[7], q);
+
+        r = _mm512_add_ps(r, q);
+
+        _mm512_storeu_ps(c + i * DCTSIZE, r);
+    }
+
+    return;
+}
+
+__attribute__((target("avx512f"))) void mj_blend_block_avx512(const mj_block_t *x, mj_block_t *y, const mj_block_t *weights, const mj_block_t *mask) {
+    int   i;
+    float s[DCTSIZE2], t[DCTSIZE2];
+
+    mj_matmul_avx512(x, &mj_dct_matrix[0][0], t);
+    mj_matmul_avx512(&mj_idct_matrix[0][0], t, s);
+
+    for(i = 0; i < DCTSIZE2; i += 16) {
+        _mm512_storeu_ps(s + i, _mm512_mul_ps(_mm512_loadu_ps(s + i), _mm512_loadu_ps(mask + i)));
+    }
+
+    mj_matmul_avx512(s, &mj_idct_matrix[0][0], t);
+    mj_matmul_avx512(&mj_dct_matrix[0][0], t, y);
+
+    return;
+}
+
+// the fixed point kernels multiply pairs of 16 bit values and add them in 32 bits (pmaddwd). the rows j and
+// j + 1 of b are interleaved, such that a[i][j] and a[i][j + 1] can be applied to them in one step. rounding
+// and saturation are the same as in mj_descale_fixed().
+
+__attribute__((target("sse2"))) static inline __m128i mj_pair_sse2(const short *a) {
+    int pair;
+
+    memcpy(&pair, a, sizeof(int));
+
+    return _mm_set1_epi32(pair);
+}
+
+__attribute__((target("sse2"))) static inline void mj_matmul_fixed_sse2(const short *a, const short *b, short *c, int shift) {
+    int     i, j;
+    __m128i blo[4], bhi[4], lo, hi, p, r0, r1;
+
+    const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    for(j = 0; j < 4; j++) {
+        r0 = _mm_loadu_si128((const __m128i *)(b + (2 * j) * DCTSIZE));
+        r1 = _mm_loadu_si128((const __m128i *)(b + (2 * j + 1) * DCTSIZE));
+        blo[j] = _mm_unpacklo_epi16(r0, r1);
+        bhi[j] = _mm_unpackhi_epi16(r0, r1);
+    }
+
+    for(i = 0; i < DCTSIZE; i++, a += DCTSIZE) {
+        p = mj_pair_sse2(a + 0);
+        lo = _mm_madd_epi16(p, blo[0]);
+        hi = _mm_madd_epi16(p, bhi[0]);
+
+        for(j = 1; j < 4; j++) {
+            p = mj_pair_sse2(a + 2 * j);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(p, blo[j]));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(p, bhi[j]));
+        }
+
+        lo = _mm_sra_epi32(_mm_add_epi32(lo, round), count);
+        hi = _mm_sra_epi32(_mm_add_epi32(hi, round), count);
+
+        _mm_storeu_si128((__m128i *)(c + i * DCTSIZE), _mm_packs_epi32(lo, hi));
+    }
+
+    return;
+}
+
+__attribute__((target("sse2"))) void mj_blend_block_fixed_sse2(const short *x, int *y, const short *mask) {
+    int     i, j;
+    short   p[DCTSIZE2], s[DCTSIZE2];
+    __m128i v, m, lo, hi, blo[4], bhi[4], r0, r1;
+
+    mj_matmul_fixed_sse2(x, &mj_dct_matrix_fixed[0][0], p, MJ_FIXED_IMAGE_BITS + MJ_FIXED_DCT_BITS - MJ_FIXED_PASS_BITS);
+    mj_matmul_fixed_sse2(&mj_idct_matrix_fixed[0][0], p, s, MJ_FIXED_DCT_BITS);
+
+    // s * mask + round in one step by pairing s with 1 and mask with the rounding constant
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i round = _mm_set1_epi16(1 << (MJ_FIXED_MASK_BITS - 1));
+
+    for(i = 0; i < DCTSIZE2; i += 8) {
+        v = _mm_loadu_si128((const __m128i *)(s + i));
+        m = _mm_loadu_si128((const __m128i *)(mask + i));
+        lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(v, one), _mm_unpacklo_epi16(m, round)), MJ_FIXED_MASK_BITS);
+        hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(v, one), _mm_unpackhi_epi16(m, round)), MJ_FIXED_MASK_BITS);
+        _mm_storeu_si128((__m128i *)(s + i), _mm_packs_epi32(lo, hi));
+    }
+
+    mj_matmul_fixed_sse2(s, &mj_idct_matrix_fixed[0][0], p, MJ_FIXED_DCT_BITS);
+
+    // y = T * p, truncated towards zero
+    for(j = 0; j < 4; j++) {
+        r0 = _mm_loadu_si128((const __m128i *)(p + (2 * j) * DCTSIZE));
+        r1 = _mm_loadu_si128((const __m128i *)(p + (2 * j + 1) * DCTSIZE));
+        blo[j] = _mm_unpacklo_epi16(r0, r1);
+        bhi[j] = _mm_unpackhi_epi16(r0, r1);
+    }
+
+    for(i = 0; i < DCTSIZE; i++) {
+        v = mj_pair_sse2(&mj_dct_matrix_fixed[i][0]);
+        lo = _mm_madd_epi16(v, blo[0]);
+        hi = _mm_madd_epi16(v, bhi[0]);
+
+        for(j = 1; j < 4; j++) {
+            v = mj_pair_sse2(&mj_dct_matrix_fixed[i][2 * j]);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(v, blo[j]));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(v, bhi[j]));
+        }
+
+        lo = _mm_add_epi32(lo, _mm_srli_epi32(_mm_srai_epi32(lo, 31), 32 - (MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS)));
+        hi = _mm_add_epi32(hi, _mm_srli_epi32(_mm_srai_epi32(hi, 31), 32 - (MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS)));
+
+        _mm_storeu_si128((__m128i *)(y + i * DCTSIZE), _mm_srai_epi32(lo, MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS));
+        _mm_storeu_si128((__m128i *)(y + i * DCTSIZE + 4), _mm_srai_epi32(hi, MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS));
+    }
+
+    return;
+}
+
+// the interleaved rows j and j + 1 of b, columns 0 to 3 in the lower and columns 4 to 7 in the upper half
+__attribute__((target("avx2"))) static inline void mj_interleave_rows_avx2(const short *b, __m256i *bp) {
+    int     j;
+    __m128i r0, r1;
+
+    for(j = 0; j < 4; j++) {
+        r0 = _mm_loadu_si128((const __m128i *)(b + (2 * j) * DCTSIZE));
+        r1 = _mm_loadu_si128((const __m128i *)(b + (2 * j + 1) * DCTSIZE));
+        bp[j] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(r0, r1)), _mm_unpackhi_epi16(r0, r1), 1);
+    }
+
+    return;
+}
+
+// one row of a * b in 32 bits
+__attribute__((target("avx2"))) static inline __m256i mj_matmul_row_avx2(const short *a, const __m256i *bp) {
+    int     pair;
+    __m256i r;
+
+    memcpy(&pair, a + 0, sizeof(int));
+    r = _mm256_madd_epi16(_mm256_set1_epi32(pair), bp[0]);
+    memcpy(&pair, a + 2, sizeof(int));
+    r = _mm256_add_epi32(r, _mm256_madd_epi16(_mm256_set1_epi32(pair), bp[1]));
+    memcpy(&pair, a + 4, sizeof(int));
+    r = _mm256_add_epi32(r, _mm256_madd_epi16(_mm256_set1_epi32(pair), bp[2]));
+    memcpy(&pair, a + 6, sizeof(int));
+    r = _mm256_add_epi32(r, _mm256_madd_epi16(_mm256_set1_epi32(pair), bp[3]));
+
+    return r;
+}
+
+__attribute__((target("avx2"))) static inline void mj_matmul_fixed_avx2(const short *a, const short *b, short *c, int shift) {
+    int     i;
+    __m256i bp[4], r0, r1;
+
+    const __m256i round = _mm256_set1_epi32(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    mj_interleave_rows_avx2(b, bp);
+
+    for(i = 0; i < DCTSIZE; i += 2) {
+        r0 = _mm256_sra_epi32(_mm256_add_epi32(mj_matmul_row_avx2(a + i * DCTSIZE, bp), round), count);
+        r1 = _mm256_sra_epi32(_mm256_add_epi32(mj_matmul_row_avx2(a + (i + 1) * DCTSIZE, bp), round), count);
+
+        // packing works within 128 bit lanes, the permutation restores the order of the two rows
+        _mm256_storeu_si256((__m256i *)(c + i * DCTSIZE), _mm256_permute4x64_epi64(_mm256_packs_epi32(r0, r1), 0xd8));
+    }
+
+    return;
+}
+
+__attribute__((target("avx2"))) void mj_blend_block_fixed_avx2(const short *x, int *y, const short *mask) {
+    int     i;
+    short   p[DCTSIZE2], s[DCTSIZE2];
+    __m256i v, m, lo, hi, bp[4];
+
+    mj_matmul_fixed_avx2(x, &mj_dct_matrix_fixed[0][0], p, MJ_FIXED_IMAGE_BITS + MJ_FIXED_DCT_BITS - MJ_FIXED_PASS_BITS);
+    mj_matmul_fixed_avx2(&mj_idct_matrix_fixed[0][0], p, s, MJ_FIXED_DCT_BITS);
+
+    // s * mask + round in one step by pairing s with 1 and mask with the rounding constant
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i round = _mm256_set1_epi16(1 << (MJ_FIXED_MASK_BITS - 1));
+
+    for(i = 0; i < DCTSIZE2; i += 16) {
+        v = _mm256_loadu_si256((const __m256i *)(s + i));
+        m = _mm256_loadu_si256((const __m256i *)(mask + i));
+        lo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(v, one), _mm256_unpacklo_epi16(m, round)), MJ_FIXED_MASK_BITS);
+        hi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(v, one), _mm256_unpackhi_epi16(m, round)), MJ_FIXED_MASK_BITS);
+        _mm256_storeu_si256((__m256i *)(s + i), _mm256_packs_epi32(lo, hi));
+    }
+
+    mj_matmul_fixed_avx2(s, &mj_idct_matrix_fixed[0][0], p, MJ_FIXED_DCT_BITS);
+
+    // y = T * p, truncated towards zero
+    mj_interleave_rows_avx2(p, bp);
+
+    for(i = 0; i < DCTSIZE; i++) {
+        v = mj_matmul_row_avx2(&mj_dct_matrix_fixed[i][0], bp);
+        v = _mm256_add_epi32(v, _mm256_srli_epi32(_mm256_srai_epi32(v, 31), 32 - (MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS)));
+
+        _mm256_storeu_si256((__m256i *)(y + i * DCTSIZE), _mm256_srai_epi32(v, MJ_FIXED_DCT_BITS + MJ_FIXED_PASS_BITS));
+    }
+
+    return;
+}
+
+#endif
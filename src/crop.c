@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "crop.h"
+
+#include "image.h"
+#include "libmodjpeg.h"
+
+#include <string.h>
+
+static void mj_crop_component(mj_jpeg_t *dst, mj_jpeg_t *src, int component, JDIMENSION block_x, JDIMENSION block_y);
+
+int mj_crop(mj_jpeg_t *m, int x, int y, int width, int height) {
+    if(m == NULL || m->coef == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    // a band of a streamed image doesn't have the blocks of the other bands
+    if(m->band_end != 0) {
+        return MJ_ERR_UNSUPPORTED_STREAMING;
+    }
+
+    if(x < 0 || y < 0 || width <= 0 || height <= 0 || x >= m->width || y >= m->height) {
+        return MJ_ERR_IMAGE_SIZE;
+    }
+
+    // the rectangle is cut off at the edges of the image first, such that extending it can't overflow
+    if(width > m->width - x) {
+        width = m->width - x;
+    }
+
+    if(height > m->height - y) {
+        height = m->height - y;
+    }
+
+    // the blocks can only be copied in whole iMCUs. the rectangle is extended to the left and
+    // to the top like jpegtran does.
+    width += x % m->sampling.h_factor;
+    height += y % m->sampling.v_factor;
+    x -= x % m->sampling.h_factor;
+    y -= y % m->sampling.v_factor;
+
+    mj_jpeg_t t;
+    int       c;
+
+    mj_init_jpeg(&t);
+    t.markers = m->markers;
+    t.splice = m->splice;
+    t.arena = m->arena;
+
+    if(mj_derive_jpeg(&t, m, width, height) != MJ_OK) {
+        mj_free_jpeg(&t);
+        return MJ_ERR_MEMORY;
+    }
+
+    for(c = 0; c < t.cinfo.num_components; c++) {
+        mj_crop_component(&t, m, c, x / m->sampling.h_factor * m->sampling.samp_factor[c].h_samp_factor, y / m->sampling.v_factor * m->sampling.samp_factor[c].v_samp_factor);
+    }
+
+    t.len = (size_t)((double)m->len * width / m->width * height / m->height);
+
+    // the cropped image replaces the image, the libjpeg objects don't point to themselves
+    mj_free_jpeg(m);
+    *m = t;
+
+    return MJ_OK;
+}
+
+static void mj_crop_component(mj_jpeg_t *dst, mj_jpeg_t *src, int component, JDIMENSION block_x, JDIMENSION block_y) {
+    jpeg_component_info *comp = &dst->cinfo.comp_info[component];
+    JBLOCKARRAY          in, out;
+    JDIMENSION           by;
+
+    for(by = 0; by < comp->height_in_blocks; by++) {
+        in = (*src->cinfo.mem->access_virt_barray)((j_common_ptr)&src->cinfo, src->coef[component], block_y + by, 1, FALSE);
+        out = (*dst->cinfo.mem->access_virt_barray)((j_common_ptr)&dst->cinfo, dst->coef[component], by, 1, TRUE);
+
+        memcpy(out[0], in[0] + block_x, comp->width_in_blocks * sizeof(JBLOCK));
+    }
+
+    return;
+}
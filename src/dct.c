@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "dct.h"
+
+#include "libmodjpeg.h"
+
+// the orthonormal DCT-II basis as used by JPEG: mj_dct_matrix[u][x] = c(u) * cos((2x + 1) * u * pi / 16)
+// with c(0) = sqrt(1/8) and c(u) = 1/2 otherwise. the 2D transform of a block is T * B * T'.
+const float mj_dct_matrix[DCTSIZE][DCTSIZE] = {
+    {0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f, 0.353553391f},
+    {0.490392640f, 0.415734806f, 0.277785117f, 0.097545161f, -0.097545161f, -0.277785117f, -0.415734806f, -0.490392640f},
+    {0.461939766f, 0.191341716f, -0.191341716f, -0.461939766f, -0.461939766f, -0.191341716f, 0.191341716f, 0.461939766f},
+    {0.415734806f, -0.097545161f, -0.490392640f, -0.277785117f, 0.277785117f, 0.490392640f, 0.097545161f, -0.415734806f},
+    {0.353553391f, -0.353553391f, -0.353553391f, 0.353553391f, 0.353553391f, -0.353553391f, -0.353553391f, 0.353553391f},
+    {0.277785117f, -0.490392640f, 0.097545161f, 0.415734806f, -0.415734806f, -0.097545161f, 0.490392640f, -0.277785117f},
+    {0.191341716f, -0.461939766f, 0.461939766f, -0.191341716f, -0.191341716f, 0.461939766f, -0.461939766f, 0.191341716f},
+    {0.097545161f, -0.277785117f, 0.415734806f, -0.490392640f, 0.490392640f, -0.415734806f, 0.277785117f, -0.097545161f},
+};
+
+// the transposed basis, mj_idct_matrix[x][u] = mj_dct_matrix[u][x]. the inverse 2D transform of a block is T' * B * T.
+const float mj_idct_matrix[DCTSIZE][DCTSIZE] = {
+    {0.353553391f, 0.490392640f, 0.461939766f, 0.415734806f, 0.353553391f, 0.277785117f, 0.191341716f, 0.097545161f},
+    {0.353553391f, 0.415734806f, 0.191341716f, -0.097545161f, -0.353553391f, -0.490392640f, -0.461939766f, -0.277785117f},
+    {0.353553391f, 0.277785117f, -0.191341716f, -0.490392640f, -0.353553391f, 0.097545161f, 0.461939766f, 0.415734806f},
+    {0.353553391f, 0.097545161f, -0.461939766f, -0.277785117f, 0.353553391f, 0.415734806f, -0.191341716f, -0.490392640f},
+    {0.353553391f, -0.097545161f, -0.461939766f, 0.277785117f, 0.353553391f, -0.415734806f, -0.191341716f, 0.490392640f},
+    {0.353553391f, -0.277785117f, -0.191341716f, 0.490392640f, -0.353553391f, -0.097545161f, 0.461939766f, -0.415734806f},
+    {0.353553391f, -0.415734806f, 0.191341716f, 0.097545161f, -0.353553391f, 0.490392640f, -0.461939766f, 0.277785117f},
+    {0.353553391f, -0.490392640f, 0.461939766f, -0.415734806f, 0.353553391f, -0.277785117f, 0.191341716f, -0.097545161f},
+};
+
+// the same bases in fixed point with MJ_FIXED_DCT_BITS fractional bits
+const short mj_dct_matrix_fixed[DCTSIZE][DCTSIZE] = {
+    {5793, 5793, 5793, 5793, 5793, 5793, 5793, 5793},
+    {8035, 6811, 4551, 1598, -1598, -4551, -6811, -8035},
+    {7568, 3135, -3135, -7568, -7568, -3135, 3135, 7568},
+    {6811, -1598, -8035, -4551, 4551, 8035, 1598, -6811},
+    {5793, -5793, -5793, 5793, 5793, -5793, -5793, 5793},
+    {4551, -8035, 1598, 6811, -6811, -1598, 8035, -4551},
+    {3135, -7568, 7568, -3135, -3135, 7568, -7568, 3135},
+    {1598, -4551, 6811, -8035, 8035, -6811, 4551, -1598},
+};
+
+const short mj_idct_matrix_fixed[DCTSIZE][DCTSIZE] = {
+    {5793, 8035, 7568, 6811, 5793, 4551, 3135, 1598},
+    {5793, 6811, 3135, -1598, -5793, -8035, -7568, -4551},
+    {5793, 4551, -3135, -8035, -5793, 1598, 7568, 6811},
+    {5793, 1598, -7568, -4551, 5793, 6811, -3135, -8035},
+    {5793, -1598, -7568, 4551, 5793, -6811, -3135, 8035},
+    {5793, -4551, -3135, 8035, -5793, -1598, 7568, -6811},
+    {5793, -6811, 3135, 1598, -5793, 8035, -7568, 4551},
+    {5793, -8035, 7568, -6811, 5793, -4551, 3135, -1598},
+};
+
+// forward DCT of 8x8 samples (row by row) into a block of coefficients in natural order.
+// the coefficients have the same scale as the de-quantized coefficients of a JPEG.
+void mj_fdct(const float *samples, mj_block_t *block) {
+    int   u, v, x;
+    float t[DCTSIZE2], s;
+
+    // columns: t = T * samples
+    for(u = 0; u < DCTSIZE; u++) {
+        for(x = 0; x < DCTSIZE; x++) {
+            s = 0.0;
+            for(v = 0; v < DCTSIZE; v++) {
+                s += mj_dct_matrix[u][v] * samples[v * DCTSIZE + x];
+            }
+            t[u * DCTSIZE + x] = s;
+        }
+    }
+
+    // rows: block = t * T'
+    for(u = 0; u < DCTSIZE; u++) {
+        for(v = 0; v < DCTSIZE; v++) {
+            s = 0.0;
+            for(x = 0; x < DCTSIZE; x++) {
+                s += t[u * DCTSIZE + x] * mj_dct_matrix[v][x];
+            }
+            block[u * DCTSIZE + v] = s;
+        }
+    }
+
+    return;
+}
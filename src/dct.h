@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_DCT_H_
+#define _LIBMODJPEG_DCT_H_
+
+#include "libmodjpeg.h"
+
+extern const float mj_dct_matrix[DCTSIZE][DCTSIZE];
+extern const float mj_idct_matrix[DCTSIZE][DCTSIZE];
+
+#define MJ_FIXED_DCT_BITS 14
+
+extern const short mj_dct_matrix_fixed[DCTSIZE][DCTSIZE];
+extern const short mj_idct_matrix_fixed[DCTSIZE][DCTSIZE];
+
+void mj_fdct(const float *samples, mj_block_t *block);
+
+#endif
@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -27,6 +28,9 @@
 #    include <png.h>
 #endif
 
+#include "arena.h"
+#include "convolve.h"
+#include "dct.h"
 #include "dropon.h"
 #include "image.h"
 #include "libmodjpeg.h"
@@ -36,29 +40,28 @@ int mj_read_dropon_from_file(mj_dropon_t *d, const char *filename, const char *m
         return MJ_ERR_NULL_DATA;
     }
 
-    int            rv;
-    unsigned char *memory = NULL, *maskmemory = NULL;
-    size_t         len = 0, masklen = 0;
+    int       rv;
+    mj_file_t f, mask;
 
-    rv = mj_read_file(&memory, &len, filename);
+    rv = mj_map_file(&f, filename);
     if(rv != MJ_OK) {
         return rv;
     }
 
+    memset(&mask, 0, sizeof(mj_file_t));
+
     if(maskfilename != NULL) {
-        rv = mj_read_file(&maskmemory, &masklen, maskfilename);
+        rv = mj_map_file(&mask, maskfilename);
         if(rv != MJ_OK) {
-            free(memory);
+            mj_unmap_file(&f);
             return rv;
         }
     }
 
-    rv = mj_read_dropon_from_memory(d, memory, len, maskmemory, masklen, blend);
+    rv = mj_read_dropon_from_memory(d, f.data, f.len, mask.data, mask.len, blend);
 
-    free(memory);
-    if(maskmemory != NULL) {
-        free(maskmemory);
-    }
+    mj_unmap_file(&f);
+    mj_unmap_file(&mask);
 
     return rv;
 }
@@ -104,29 +107,29 @@ int mj_read_dropon_from_jpeg_memory(mj_dropon_t *d, const unsigned char *memory,
     int            image_width = 0, alpha_width = 0;
     int            image_height = 0, alpha_height = 0;
 
-    rv = mj_decode_jpeg_memory_to_raw(&image_buffer, &image_width, &image_height, MJ_COLORSPACE_RGB, memory, len);
+    rv = mj_decode_jpeg_memory_to_raw(&image_buffer, &image_width, &image_height, MJ_COLORSPACE_RGB, memory, len, d->arena);
     if(rv != MJ_OK) {
         return rv;
     }
 
     if(maskmemory != NULL && masklen != 0) {
-        rv = mj_decode_jpeg_memory_to_raw(&alpha_buffer, &alpha_width, &alpha_height, MJ_COLORSPACE_GRAYSCALE, maskmemory, masklen);
+        rv = mj_decode_jpeg_memory_to_raw(&alpha_buffer, &alpha_width, &alpha_height, MJ_COLORSPACE_GRAYSCALE, maskmemory, masklen, d->arena);
         if(rv != MJ_OK) {
-            free(image_buffer);
+            mj_release(d->arena, image_buffer);
             return rv;
         }
 
         if(image_width != alpha_width || image_height != alpha_height) {
-            free(image_buffer);
-            free(alpha_buffer);
+            mj_release(d->arena, image_buffer);
+            mj_release(d->arena, alpha_buffer);
 
             return MJ_ERR_DROPON_DIMENSIONS;
         }
 
-        buffer = (unsigned char *)calloc(4 * image_width * image_height, sizeof(unsigned char));
+        buffer = (unsigned char *)mj_alloc(d->arena, 4 * (size_t)image_width * image_height);
         if(buffer == NULL) {
-            free(image_buffer);
-            free(alpha_buffer);
+            mj_release(d->arena, image_buffer);
+            mj_release(d->arena, alpha_buffer);
 
             return MJ_ERR_MEMORY;
         }
@@ -150,11 +153,11 @@ int mj_read_dropon_from_jpeg_memory(mj_dropon_t *d, const unsigned char *memory,
 
     rv = mj_read_dropon_from_raw(d, buffer, colorspace, image_width, image_height, blend);
 
-    free(image_buffer);
+    mj_release(d->arena, image_buffer);
 
     if(alpha_buffer != NULL) {
-        free(alpha_buffer);
-        free(buffer);
+        mj_release(d->arena, alpha_buffer);
+        mj_release(d->arena, buffer);
     }
 
     return rv;
@@ -179,20 +182,20 @@ int mj_read_dropon_from_png_memory(mj_dropon_t *d, const unsigned char *memory,
     png_bytep buffer;
     image.format = PNG_FORMAT_RGBA;
 
-    buffer = malloc(PNG_IMAGE_SIZE(image));
+    buffer = (png_bytep)mj_alloc(d->arena, PNG_IMAGE_SIZE(image));
     if(buffer == NULL) {
         return MJ_ERR_MEMORY;
     }
 
     if(png_image_finish_read(&image, NULL, buffer, 0, NULL) == 0) {
-        free(buffer);
+        mj_release(d->arena, buffer);
         return MJ_ERR_FILEIO;
     }
 
     int rv;
     rv = mj_read_dropon_from_raw(d, buffer, MJ_COLORSPACE_RGBA, image.width, image.height, MJ_BLEND_NONUNIFORM);
 
-    free(buffer);
+    mj_release(d->arena, buffer);
 
     png_image_free(&image);
 
@@ -238,14 +241,14 @@ int mj_read_dropon_from_raw(mj_dropon_t *d, const unsigned char *rawdata, unsign
     // easier to handle later for compiling the dropon.
     size_t nsamples = 3 * width * height;
 
-    d->image = (unsigned char *)calloc(nsamples, sizeof(unsigned char));
+    d->image = (unsigned char *)mj_alloc(d->arena, nsamples);
     if(d->image == NULL) {
         mj_free_dropon(d);
         return MJ_ERR_MEMORY;
     }
 
     // the alpha channel is also stored with 3 component
-    d->alpha = (unsigned char *)calloc(nsamples, sizeof(unsigned char));
+    d->alpha = (unsigned char *)mj_alloc(d->arena, nsamples);
     if(d->alpha == NULL) {
         mj_free_dropon(d);
         return MJ_ERR_MEMORY;
@@ -322,19 +325,83 @@ int mj_read_dropon_from_raw(mj_dropon_t *d, const unsigned char *rawdata, unsign
     return MJ_OK;
 }
 
-int mj_compile_dropon(mj_compileddropon_t *cd, mj_dropon_t *d, J_COLOR_SPACE colorspace, mj_sampling_t *sampling, int blockoffset_x, int blockoffset_y, int crop_x, int crop_y, int crop_w, int crop_h) {
+int mj_compile_dropon(mj_compileddropon_t *cd, mj_dropon_t *d, J_COLOR_SPACE colorspace, mj_sampling_t *sampling, int blockoffset_x, int blockoffset_y) {
+    return mj_compile_dropon_options(cd, d, colorspace, sampling, blockoffset_x, blockoffset_y, MJ_OPTION_NONE);
+}
+
+int mj_compile_dropon_options(mj_compileddropon_t *cd, mj_dropon_t *d, J_COLOR_SPACE colorspace, mj_sampling_t *sampling, int blockoffset_x, int blockoffset_y, int options) {
+    if(cd == NULL || d == NULL || sampling == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    if(d->image == NULL || d->alpha == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    // the block offset is the position of the top-left corner of the dropon
+    // within the block it will be placed in
+    if(blockoffset_x < 0 || blockoffset_x >= sampling->h_factor || blockoffset_y < 0 || blockoffset_y >= sampling->v_factor) {
+        return MJ_ERR_DROPON_DIMENSIONS;
+    }
+
+    return mj_compile_dropon_area(cd, d, colorspace, sampling, blockoffset_x, blockoffset_y, 0, 0, d->width, d->height, options);
+}
+
+int mj_compile_dropon_area(mj_compileddropon_t *cd, mj_dropon_t *d, J_COLOR_SPACE colorspace, mj_sampling_t *sampling, int blockoffset_x, int blockoffset_y, int crop_x, int crop_y, int crop_w, int crop_h, int options) {
     if(cd == NULL || d == NULL) {
         return MJ_ERR_NULL_DATA;
     }
 
+    mj_init_compileddropon(cd);
+
+    cd->arena = d->arena;
+
+    cd->width = crop_w;
+    cd->height = crop_h;
+    cd->blend = d->blend;
+    cd->options = options;
+
+    cd->sampling = *sampling;
+
+    cd->blockoffset_x = blockoffset_x;
+    cd->blockoffset_y = blockoffset_y;
+
     // crop and or extend the dropon. the dropon needs to cover whole blocks.
 
-    // after that, encode it to a jpeg with the same colorspace and sampling as the image.
+    // after that, convert it to the colorspace of the image, downsample each component
+    // according to the sampling of the image and transform the blocks with a forward DCT.
     // this gives us the the dropon in frequency space.
 
     // same for the mask. the mask is required if we extend the dropon such that
     // the extended area doesn't cover the image.
 
+    int ncomponents = 0;
+
+    switch(colorspace) {
+        case JCS_GRAYSCALE:
+            ncomponents = 1;
+            break;
+        case JCS_RGB:
+        case JCS_YCbCr:
+            ncomponents = 3;
+            break;
+        default:
+            return MJ_ERR_UNSUPPORTED_COLORSPACE;
+    }
+
+    // each component has to be downsampled by a whole number
+    int c;
+
+    for(c = 0; c < ncomponents; c++) {
+        if(sampling->samp_factor[c].h_samp_factor <= 0 || sampling->samp_factor[c].v_samp_factor <= 0) {
+            return MJ_ERR_UNSUPPORTED_SAMPLING;
+        }
+
+        if(sampling->max_h_samp_factor % sampling->samp_factor[c].h_samp_factor != 0 || sampling->max_v_samp_factor % sampling->samp_factor[c].v_samp_factor != 0) {
+            return MJ_ERR_UNSUPPORTED_SAMPLING;
+        }
+    }
+
     // crop/extend the dropon
 
     int width = crop_w + blockoffset_x;
@@ -349,228 +416,309 @@ int mj_compile_dropon(mj_compileddropon_t *cd, mj_dropon_t *d, J_COLOR_SPACE col
         height += sampling->v_factor - padding;
     }
 
-    unsigned char *data = (unsigned char *)calloc(3 * width * height, sizeof(unsigned char));
-    if(data == NULL) {
+    size_t nsamples = (size_t)width * (size_t)height;
+
+    float *image = (float *)mj_alloc(cd->arena, 3 * nsamples * sizeof(float));
+    if(image == NULL) {
+        return MJ_ERR_MEMORY;
+    }
+
+    float *alpha = (float *)mj_alloc(cd->arena, nsamples * sizeof(float));
+    if(alpha == NULL) {
+        mj_release(cd->arena, image);
         return MJ_ERR_MEMORY;
     }
 
-    int            i, j;
-    unsigned char *p, *q;
+    // this buffer will hold the downsampled samples of one component
+    float *samples = (float *)mj_alloc(cd->arena, nsamples * sizeof(float));
+    if(samples == NULL) {
+        mj_release(cd->arena, image);
+        mj_release(cd->arena, alpha);
+        return MJ_ERR_MEMORY;
+    }
+
+    int                  i, j, x, y;
+    float *              p, *q;
+    const unsigned char *r;
+
+    // the extended area gets the color of the nearest pixel of the dropon such that it
+    // doesn't bleed into the dropon when downsampling. it is masked out by the alpha.
+    for(i = 0; i < height; i++) {
+        y = i - blockoffset_y;
+        if(y < 0) {
+            y = 0;
+        }
+        else if(y >= crop_h) {
+            y = crop_h - 1;
+        }
+
+        p = &image[(size_t)i * width * 3];
+        q = &alpha[(size_t)i * width];
+
+        for(j = 0; j < width; j++) {
+            x = j - blockoffset_x;
+            if(x < 0) {
+                x = 0;
+            }
+            else if(x >= crop_w) {
+                x = crop_w - 1;
+            }
 
-    for(i = crop_y; i < (crop_y + crop_h); i++) {
-        p = &data[(i - crop_y + blockoffset_y) * width * 3 + (blockoffset_x * 3)];
-        q = &d->image[i * d->width * 3 + (crop_x * 3)];
+            r = &d->image[((size_t)(y + crop_y) * d->width + (x + crop_x)) * 3];
+            mj_convert_dropon_sample(p, r, d->colorspace, colorspace);
+            p += 3;
 
-        for(j = crop_x; j < (crop_x + crop_w); j++) {
-            *p++ = *q++;
-            *p++ = *q++;
-            *p++ = *q++;
+            if(i < blockoffset_y || i >= blockoffset_y + crop_h || j < blockoffset_x || j >= blockoffset_x + crop_w) {
+                *q++ = 0.0;
+            }
+            else {
+                // all components of the alpha channel are the same
+                *q++ = (float)d->alpha[((size_t)(y + crop_y) * d->width + (x + crop_x)) * 3];
+            }
         }
     }
 
-    int            rv;
-    unsigned char *buffer = NULL;
-    size_t         len = 0;
+    cd->image_ncomponents = ncomponents;
+    cd->image_colorspace = colorspace;
+    cd->image = (mj_component_t *)mj_alloc(cd->arena, ncomponents * sizeof(mj_component_t));
 
-    // encode the dropon to JPEG
-    rv = mj_encode_raw_to_jpeg_memory(&buffer, &len, data, d->colorspace, colorspace, sampling, width, height);
-    if(rv != MJ_OK) {
-        free(data);
-        return rv;
+    cd->alpha_ncomponents = ncomponents;
+    cd->alpha = (mj_component_t *)mj_alloc(cd->arena, ncomponents * sizeof(mj_component_t));
+    cd->mask = (mj_component_t *)mj_alloc(cd->arena, ncomponents * sizeof(mj_component_t));
+
+    if(cd->image == NULL || cd->alpha == NULL || cd->mask == NULL) {
+        mj_release(cd->arena, image);
+        mj_release(cd->arena, alpha);
+        mj_release(cd->arena, samples);
+        mj_free_compileddropon(cd);
+        return MJ_ERR_MEMORY;
+    }
+
+    int rv = MJ_OK;
+
+    for(c = 0; c < ncomponents; c++) {
+        mj_downsample_plane(samples, image + c, 3, width, height, sampling, c);
+        rv = mj_compile_component(&cd->image[c], samples, width, height, sampling, c, MJ_COMPONENT_IMAGE, cd->arena);
+        if(rv == MJ_OK && (options & MJ_OPTION_FIXEDPOINT)) {
+            rv = mj_compile_component_fixed(&cd->image[c], MJ_COMPONENT_IMAGE, cd->arena);
+        }
+        if(rv != MJ_OK) {
+            break;
+        }
+
+        mj_downsample_plane(samples, alpha, 1, width, height, sampling, c);
+        rv = mj_compile_component(&cd->alpha[c], samples, width, height, sampling, c, MJ_COMPONENT_ALPHA, cd->arena);
+        if(rv != MJ_OK) {
+            break;
+        }
+
+        rv = mj_compile_component(&cd->mask[c], samples, width, height, sampling, c, MJ_COMPONENT_MASK, cd->arena);
+        if(rv == MJ_OK && (options & MJ_OPTION_FIXEDPOINT)) {
+            rv = mj_compile_component_fixed(&cd->mask[c], MJ_COMPONENT_MASK, cd->arena);
+        }
+        if(rv != MJ_OK) {
+            break;
+        }
     }
 
-    // read the coefficients from the encoded dropon
-    rv = mj_read_droponimage_from_memory(cd, buffer, len);
-    free(buffer);
+    mj_release(cd->arena, image);
+    mj_release(cd->arena, alpha);
+    mj_release(cd->arena, samples);
 
     if(rv != MJ_OK) {
-        free(data);
-        return rv;
+        mj_free_compileddropon(cd);
     }
 
-    for(i = crop_y; i < (crop_y + crop_h); i++) {
-        p = &data[(i - crop_y + blockoffset_y) * width * 3 + (blockoffset_x * 3)];
-        q = &d->alpha[i * d->width * 3 + (crop_x * 3)];
+    return rv;
+}
+
+void mj_convert_dropon_sample(float *dst, const unsigned char *src, int colorspace, J_COLOR_SPACE jpeg_colorspace) {
+    float a = (float)src[0], b = (float)src[1], c = (float)src[2];
+
+    // the same color transformations as in the JPEG library. a grayscale dropon is stored
+    // with three equal components, i.e. it can be treated as RGB.
+    if(colorspace == MJ_COLORSPACE_YCC) {
+        if(jpeg_colorspace == JCS_RGB) {
+            dst[0] = a + 1.402f * (c - 128.0f);
+            dst[1] = a - 0.344136f * (b - 128.0f) - 0.714136f * (c - 128.0f);
+            dst[2] = a + 1.772f * (b - 128.0f);
 
-        for(j = crop_x; j < (crop_x + crop_w); j++) {
-            *p++ = *q++;
-            *p++ = *q++;
-            *p++ = *q++;
+            for(int i = 0; i < 3; i++) {
+                if(dst[i] < 0.0f) {
+                    dst[i] = 0.0f;
+                }
+                else if(dst[i] > 255.0f) {
+                    dst[i] = 255.0f;
+                }
+            }
         }
+        else {
+            dst[0] = a;
+            dst[1] = b;
+            dst[2] = c;
+        }
+
+        return;
     }
 
-    // encode the mask to JPEG. all components of the mask are the same. depending on the targeted colorspace,
-    // the data of the mask needs to be interpreted differently
-    // for the target colorspaces, we support only GRAYSCALE, RGB, and YCC
-    // the JPEG library supports only these internal color transformations
-    //    RGB => RGB
-    //    RGB => YCC
-    //    RGB => GRAYSCALE
-    //    YCC => YCC
-    //    YCC => GRAYSCALE
-    int alpha_colorspace = MJ_COLORSPACE_YCC;
-    if(colorspace == JCS_RGB) {
-        alpha_colorspace = MJ_COLORSPACE_RGB;
+    if(jpeg_colorspace == JCS_RGB) {
+        dst[0] = a;
+        dst[1] = b;
+        dst[2] = c;
     }
-    rv = mj_encode_raw_to_jpeg_memory(&buffer, &len, data, alpha_colorspace, colorspace, sampling, width, height);
-    if(rv != MJ_OK) {
-        free(data);
-        return rv;
+    else {
+        dst[0] = 0.299f * a + 0.587f * b + 0.114f * c;
+        dst[1] = -0.168735892f * a - 0.331264108f * b + 0.5f * c + 128.0f;
+        dst[2] = 0.5f * a - 0.418687589f * b - 0.081312411f * c + 128.0f;
     }
 
-    // read the coefficients from the encoded dropon mask
-    rv = mj_read_droponalpha_from_memory(cd, buffer, len);
+    return;
+}
 
-    free(buffer);
-    free(data);
+void mj_downsample_plane(float *dst, const float *src, int stride, int width, int height, mj_sampling_t *sampling, int component) {
+    // average the samples that fall into one sample of the component
+    int fx = sampling->max_h_samp_factor / sampling->samp_factor[component].h_samp_factor;
+    int fy = sampling->max_v_samp_factor / sampling->samp_factor[component].v_samp_factor;
 
-    return rv;
-}
+    int   width_c = width / fx, height_c = height / fy;
+    int   i, j, k, l;
+    float s, scale = 1.0f / (float)(fx * fy);
 
-int mj_read_droponimage_from_memory(mj_compileddropon_t *cd, const unsigned char *memory, size_t len) {
-    if(cd == NULL) {
-        return MJ_ERR_NULL_DATA;
+    for(i = 0; i < height_c; i++) {
+        for(j = 0; j < width_c; j++) {
+            s = 0.0;
+
+            for(k = 0; k < fy; k++) {
+                for(l = 0; l < fx; l++) {
+                    s += src[(((size_t)(i * fy + k) * width) + (j * fx + l)) * stride];
+                }
+            }
+
+            dst[(size_t)i * width_c + j] = s * scale;
+        }
     }
 
-    mj_jpeg_t m;
-    int       rv;
+    return;
+}
 
-    mj_init_jpeg(&m);
+int mj_compile_component(mj_component_t *comp, const float *samples, int width, int height, mj_sampling_t *sampling, int component, int type, mj_arena_t *arena) {
+    comp->h_samp_factor = sampling->samp_factor[component].h_samp_factor;
+    comp->v_samp_factor = sampling->samp_factor[component].v_samp_factor;
 
-    rv = mj_read_jpeg_from_memory(&m, memory, len, 0);
-    if(rv != MJ_OK) {
-        return rv;
-    }
+    // the downsampled component has a whole number of blocks because the dropon is extended to whole MCUs
+    int width_c = width * comp->h_samp_factor / sampling->max_h_samp_factor;
+    int height_c = height * comp->v_samp_factor / sampling->max_v_samp_factor;
 
-    int                  c, k, l, i;
-    jpeg_component_info *component;
-    mj_component_t *     comp;
-    mj_block_t *         b;
-    JBLOCKARRAY          blocks;
-    JCOEFPTR             coefs;
+    comp->width_in_blocks = width_c / DCTSIZE;
+    comp->height_in_blocks = height_c / DCTSIZE;
 
-    cd->image_ncomponents = m.cinfo.num_components;
-    cd->image_colorspace = m.cinfo.jpeg_color_space;
-    cd->image = (mj_component_t *)calloc(cd->image_ncomponents, sizeof(mj_component_t));
+    comp->nblocks = comp->width_in_blocks * comp->height_in_blocks;
+    comp->blocks = mj_alloc_blocks(comp->nblocks, arena);
+    if(comp->blocks == NULL) {
+        comp->nblocks = 0;
+        return MJ_ERR_MEMORY;
+    }
 
-    for(c = 0; c < m.cinfo.num_components; c++) {
-        component = &m.cinfo.comp_info[c];
-        comp = &cd->image[c];
+    if(type == MJ_COMPONENT_MASK) {
+        comp->blocktypes = (unsigned char *)mj_alloc(arena, comp->nblocks);
+        if(comp->blocktypes == NULL) {
+            return MJ_ERR_MEMORY;
+        }
+    }
 
-        comp->h_samp_factor = component->h_samp_factor;
-        comp->v_samp_factor = component->v_samp_factor;
+    int         k, l, i, j;
+    float       block[DCTSIZE2];
+    mj_block_t *b = comp->blocks;
 
-        comp->width_in_blocks = component->width_in_blocks;
-        comp->height_in_blocks = component->height_in_blocks;
+    for(l = 0; l < comp->height_in_blocks; l++) {
+        for(k = 0; k < comp->width_in_blocks; k++, b += DCTSIZE2) {
+            for(i = 0; i < DCTSIZE; i++) {
+                for(j = 0; j < DCTSIZE; j++) {
+                    block[i * DCTSIZE + j] = samples[(size_t)(l * DCTSIZE + i) * width_c + (k * DCTSIZE + j)];
+                }
+            }
 
-        comp->nblocks = comp->width_in_blocks * comp->height_in_blocks;
-        comp->blocks = (mj_block_t **)calloc(comp->nblocks, sizeof(mj_block_t *));
+            if(type == MJ_COMPONENT_MASK) {
+                comp->blocktypes[comp->width_in_blocks * l + k] = (unsigned char)mj_classify_block(block);
 
-        for(l = 0; l < comp->height_in_blocks; l++) {
-            blocks = (*m.cinfo.mem->access_virt_barray)((j_common_ptr)&m.cinfo, m.coef[c], l, 1, TRUE);
+                // the mask stays in the spatial domain, scaled to [0, 1]
+                for(i = 0; i < DCTSIZE2; i++) {
+                    b[i] = block[i] / 255.0f;
+                }
 
-            for(k = 0; k < comp->width_in_blocks; k++) {
-                b = (mj_block_t *)calloc(64, sizeof(mj_block_t));
-                coefs = blocks[0][k];
+                continue;
+            }
 
-                for(i = 0; i < DCTSIZE2; i += 8) {
-                    b[i + 0] = (float)coefs[i + 0];
-                    b[i + 1] = (float)coefs[i + 1];
-                    b[i + 2] = (float)coefs[i + 2];
-                    b[i + 3] = (float)coefs[i + 3];
-                    b[i + 4] = (float)coefs[i + 4];
-                    b[i + 5] = (float)coefs[i + 5];
-                    b[i + 6] = (float)coefs[i + 6];
-                    b[i + 7] = (float)coefs[i + 7];
+            if(type == MJ_COMPONENT_IMAGE) {
+                // level shift, as for encoding the image
+                for(i = 0; i < DCTSIZE2; i++) {
+                    block[i] -= 128.0f;
                 }
 
-                comp->blocks[comp->width_in_blocks * l + k] = b;
+                mj_fdct(block, b);
+
+                continue;
+            }
+
+            mj_fdct(block, b);
+
+            // w'(j, i) = w(j, i) * 1/255 * c(i) * c(j) * 1/4
+            // the factor 1/4 comes from V(i) and V(j)
+            // => 1/255 * 1/4 = 1/1020
+
+            b[0] *= (0.3535534 * 0.3535534 / 1020.0);
+            b[1] *= (0.3535534 * 0.5 / 1020.0);
+            b[2] *= (0.3535534 * 0.5 / 1020.0);
+            b[3] *= (0.3535534 * 0.5 / 1020.0);
+            b[4] *= (0.3535534 * 0.5 / 1020.0);
+            b[5] *= (0.3535534 * 0.5 / 1020.0);
+            b[6] *= (0.3535534 * 0.5 / 1020.0);
+            b[7] *= (0.3535534 * 0.5 / 1020.0);
+
+            for(i = 8; i < DCTSIZE2; i += 8) {
+                b[i + 0] *= (0.5 * 0.3535534 / 1020.0);
+                b[i + 1] *= (0.5 * 0.5 / 1020.0);
+                b[i + 2] *= (0.5 * 0.5 / 1020.0);
+                b[i + 3] *= (0.5 * 0.5 / 1020.0);
+                b[i + 4] *= (0.5 * 0.5 / 1020.0);
+                b[i + 5] *= (0.5 * 0.5 / 1020.0);
+                b[i + 6] *= (0.5 * 0.5 / 1020.0);
+                b[i + 7] *= (0.5 * 0.5 / 1020.0);
             }
         }
     }
 
-    mj_free_jpeg(&m);
-
     return MJ_OK;
 }
 
-int mj_read_droponalpha_from_memory(mj_compileddropon_t *cd, const unsigned char *memory, size_t len) {
-    if(cd == NULL) {
-        return MJ_ERR_NULL_DATA;
-    }
-
-    mj_jpeg_t m;
-    int       rv;
+int mj_compile_component_fixed(mj_component_t *comp, int type, mj_arena_t *arena) {
+    int   i;
+    float v, scale = (float)(1 << MJ_FIXED_IMAGE_BITS);
 
-    mj_init_jpeg(&m);
+    // the fixed point blending only needs the coefficients of the image and the mask. the alpha
+    // weights are only used by the convolution in the frequency domain.
+    if(type == MJ_COMPONENT_MASK) {
+        scale = (float)(1 << MJ_FIXED_MASK_BITS);
+    }
 
-    rv = mj_read_jpeg_from_memory(&m, memory, len, 0);
-    if(rv != MJ_OK) {
-        return rv;
+    comp->fixedblocks = mj_alloc_fixedblocks(comp->nblocks, arena);
+    if(comp->fixedblocks == NULL) {
+        return MJ_ERR_MEMORY;
     }
 
-    int                  c, k, l, i;
-    jpeg_component_info *component;
-    mj_component_t *     comp;
-    mj_block_t *         b;
-    JBLOCKARRAY          blocks;
-    JCOEFPTR             coefs;
-
-    cd->alpha_ncomponents = m.cinfo.num_components;
-    cd->alpha = (mj_component_t *)calloc(cd->alpha_ncomponents, sizeof(mj_component_t));
-
-    for(c = 0; c < m.cinfo.num_components; c++) {
-        component = &m.cinfo.comp_info[c];
-        comp = &cd->alpha[c];
-
-        comp->h_samp_factor = component->h_samp_factor;
-        comp->v_samp_factor = component->v_samp_factor;
-
-        comp->width_in_blocks = component->width_in_blocks;
-        comp->height_in_blocks = component->height_in_blocks;
-
-        comp->nblocks = comp->width_in_blocks * comp->height_in_blocks;
-        comp->blocks = (mj_block_t **)calloc(comp->nblocks, sizeof(mj_block_t *));
-
-        for(l = 0; l < comp->height_in_blocks; l++) {
-            blocks = (*m.cinfo.mem->access_virt_barray)((j_common_ptr)&m.cinfo, m.coef[c], l, 1, TRUE);
-
-            for(k = 0; k < comp->width_in_blocks; k++) {
-                b = (mj_block_t *)calloc(64, sizeof(mj_block_t));
-                coefs = blocks[0][k];
-
-                coefs[0] += 1024;
-
-                // w'(j, i) = w(j, i) * 1/255 * c(i) * c(j) * 1/4
-                // the factor 1/4 comes from V(i) and V(j)
-                // => 1/255 * 1/4 = 1/1020
-
-                b[0] = (float)coefs[0] * (0.3535534 * 0.3535534 / 1020.0);
-                b[1] = (float)coefs[1] * (0.3535534 * 0.5 / 1020.0);
-                b[2] = (float)coefs[2] * (0.3535534 * 0.5 / 1020.0);
-                b[3] = (float)coefs[3] * (0.3535534 * 0.5 / 1020.0);
-                b[4] = (float)coefs[4] * (0.3535534 * 0.5 / 1020.0);
-                b[5] = (float)coefs[5] * (0.3535534 * 0.5 / 1020.0);
-                b[6] = (float)coefs[6] * (0.3535534 * 0.5 / 1020.0);
-                b[7] = (float)coefs[7] * (0.3535534 * 0.5 / 1020.0);
-
-                for(i = 8; i < DCTSIZE2; i += 8) {
-                    b[i + 0] = (float)coefs[i + 0] * (0.5 * 0.3535534 / 1020.0);
-                    b[i + 1] = (float)coefs[i + 1] * (0.5 * 0.5 / 1020.0);
-                    b[i + 2] = (float)coefs[i + 2] * (0.5 * 0.5 / 1020.0);
-                    b[i + 3] = (float)coefs[i + 3] * (0.5 * 0.5 / 1020.0);
-                    b[i + 4] = (float)coefs[i + 4] * (0.5 * 0.5 / 1020.0);
-                    b[i + 5] = (float)coefs[i + 5] * (0.5 * 0.5 / 1020.0);
-                    b[i + 6] = (float)coefs[i + 6] * (0.5 * 0.5 / 1020.0);
-                    b[i + 7] = (float)coefs[i + 7] * (0.5 * 0.5 / 1020.0);
-                }
+    for(i = 0; i < comp->nblocks * DCTSIZE2; i++) {
+        v = comp->blocks[i] * scale;
 
-                comp->blocks[comp->width_in_blocks * l + k] = b;
-            }
+        if(v > (float)SHRT_MAX) {
+            v = (float)SHRT_MAX;
+        }
+        else if(v < (float)SHRT_MIN) {
+            v = (float)SHRT_MIN;
         }
-    }
 
-    mj_free_jpeg(&m);
+        // round half away from zero
+        comp->fixedblocks[i] = (short)(v < 0.0f ? v - 0.5f : v + 0.5f);
+    }
 
     return MJ_OK;
 }
@@ -590,16 +738,31 @@ void mj_free_dropon(mj_dropon_t *d) {
         return;
     }
 
+    // the arena is kept for the next dropon
+    mj_arena_t *arena = d->arena;
+
     if(d->image != NULL) {
-        free(d->image);
+        mj_release(arena, d->image);
     }
 
     if(d->alpha != NULL) {
-        free(d->alpha);
+        mj_release(arena, d->alpha);
     }
 
     mj_init_dropon(d);
 
+    d->arena = arena;
+
+    return;
+}
+
+void mj_init_compileddropon(mj_compileddropon_t *cd) {
+    if(cd == NULL) {
+        return;
+    }
+
+    memset(cd, 0, sizeof(mj_compileddropon_t));
+
     return;
 }
 
@@ -612,35 +775,103 @@ void mj_free_compileddropon(mj_compileddropon_t *cd) {
 
     if(cd->image != NULL) {
         for(i = 0; i < cd->image_ncomponents; i++) {
-            mj_free_component(&cd->image[i]);
+            mj_free_component(&cd->image[i], cd->arena);
         }
-        free(cd->image);
-        cd->image = NULL;
+        mj_release(cd->arena, cd->image);
     }
 
     if(cd->alpha != NULL) {
         for(i = 0; i < cd->alpha_ncomponents; i++) {
-            mj_free_component(&cd->alpha[i]);
+            mj_free_component(&cd->alpha[i], cd->arena);
+        }
+        mj_release(cd->arena, cd->alpha);
+    }
+
+    if(cd->mask != NULL) {
+        for(i = 0; i < cd->alpha_ncomponents; i++) {
+            mj_free_component(&cd->mask[i], cd->arena);
         }
-        free(cd->alpha);
-        cd->alpha = NULL;
+        mj_release(cd->arena, cd->mask);
     }
 
+    mj_init_compileddropon(cd);
+
     return;
 }
 
-void mj_free_component(mj_component_t *c) {
+void mj_free_component(mj_component_t *c, mj_arena_t *arena) {
     if(c == NULL) {
         return;
     }
 
+    mj_release(arena, c->blocks);
+    mj_release(arena, c->fixedblocks);
+    mj_release(arena, c->blocktypes);
+
+    return;
+}
+
+int mj_classify_block(const float *samples) {
+    // the type of a block of alpha samples decides how it will be blended with the image
     int i;
 
-    for(i = 0; i < c->nblocks; i++) {
-        free(c->blocks[i]);
+    for(i = 1; i < DCTSIZE2; i++) {
+        if(samples[i] != samples[0]) {
+            return MJ_BLOCK_PARTIAL;
+        }
     }
 
-    free(c->blocks);
+    if(samples[0] == 0.0) {
+        return MJ_BLOCK_TRANSPARENT;
+    }
 
-    return;
+    if(samples[0] == 255.0) {
+        return MJ_BLOCK_OPAQUE;
+    }
+
+    return MJ_BLOCK_UNIFORM;
+}
+
+mj_block_t *mj_alloc_blocks(int nblocks, mj_arena_t *arena) {
+    // all blocks of a component are kept in one slab, aligned to a cache line
+    void * p = NULL;
+    size_t size = (size_t)nblocks * DCTSIZE2 * sizeof(mj_block_t);
+
+    if(size == 0) {
+        size = DCTSIZE2 * sizeof(mj_block_t);
+    }
+
+    // the arena is aligned to a cache line as well
+    if(arena != NULL) {
+        return (mj_block_t *)mj_alloc(arena, size);
+    }
+
+    if(posix_memalign(&p, MJ_BLOCK_ALIGNMENT, size) != 0) {
+        return NULL;
+    }
+
+    memset(p, 0, size);
+
+    return (mj_block_t *)p;
+}
+
+short *mj_alloc_fixedblocks(int nblocks, mj_arena_t *arena) {
+    void * p = NULL;
+    size_t size = (size_t)nblocks * DCTSIZE2 * sizeof(short);
+
+    if(size == 0) {
+        size = DCTSIZE2 * sizeof(short);
+    }
+
+    if(arena != NULL) {
+        return (short *)mj_alloc(arena, size);
+    }
+
+    if(posix_memalign(&p, MJ_BLOCK_ALIGNMENT, size) != 0) {
+        return NULL;
+    }
+
+    memset(p, 0, size);
+
+    return (short *)p;
 }
@@ -25,13 +25,27 @@
 
 #include "libmodjpeg.h"
 
-int mj_read_droponimage_from_memory(mj_compileddropon_t *cd, const unsigned char *memory, size_t len);
-int mj_read_droponalpha_from_memory(mj_compileddropon_t *cd, const unsigned char *memory, size_t len);
+#define MJ_BLOCK_ALIGNMENT 64
 
-int mj_compile_dropon(mj_compileddropon_t *cd, mj_dropon_t *d, J_COLOR_SPACE colorspace, mj_sampling_t *s, int blockoffset_x, int blockoffset_y, int crop_x, int crop_y, int crop_w, int crop_h);
+#define MJ_COMPONENT_IMAGE 0
+#define MJ_COMPONENT_ALPHA 1
+#define MJ_COMPONENT_MASK  2
 
-void mj_free_compileddropon(mj_compileddropon_t *cd);
-void mj_free_component(mj_component_t *c);
+#define MJ_BLOCK_TRANSPARENT 0    // the alpha of all samples is 0
+#define MJ_BLOCK_OPAQUE      1    // the alpha of all samples is 255
+#define MJ_BLOCK_UNIFORM     2    // all samples have the same alpha
+#define MJ_BLOCK_PARTIAL     3    // the samples have different alpha
+
+int  mj_compile_dropon_area(mj_compileddropon_t *cd, mj_dropon_t *d, J_COLOR_SPACE colorspace, mj_sampling_t *s, int blockoffset_x, int blockoffset_y, int crop_x, int crop_y, int crop_w, int crop_h, int options);
+void mj_convert_dropon_sample(float *dst, const unsigned char *src, int colorspace, J_COLOR_SPACE jpeg_colorspace);
+void mj_downsample_plane(float *dst, const float *src, int stride, int width, int height, mj_sampling_t *sampling, int component);
+int  mj_compile_component(mj_component_t *comp, const float *samples, int width, int height, mj_sampling_t *sampling, int component, int type, mj_arena_t *arena);
+int  mj_compile_component_fixed(mj_component_t *comp, int type, mj_arena_t *arena);
+
+void        mj_free_component(mj_component_t *c, mj_arena_t *arena);
+mj_block_t *mj_alloc_blocks(int nblocks, mj_arena_t *arena);
+short *     mj_alloc_fixedblocks(int nblocks, mj_arena_t *arena);
+int         mj_classify_block(const float *samples);
 
 int mj_read_dropon_from_jpeg_memory(mj_dropon_t *d, const unsigned char *memory, size_t len, const unsigned char *maskmemory, size_t masklen, short blend);
 #ifdef WITH_LIBPNG
@@ -22,201 +22,646 @@
 
 #include "effect.h"
 
+#include "image.h"
 #include "jpeg.h"
 #include "libmodjpeg.h"
+#include "quant.h"
+#include "splice.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// the limits of the dequantized coefficients. baseline JPEGs have at most 11 bits for DC and 10 bits for AC.
+#define MJ_PIPELINE_MAX_DC 2047
+#define MJ_PIPELINE_MAX_AC 1023
+
+// the largest scale factor after combining the ops of a pipeline
+#define MJ_PIPELINE_MAX_SCALE (256 * MJ_PIPELINE_ONE)
+
+static int       mj_pipeline_apply(mj_jpeg_t *m, mj_pipeline_t *p, const mj_rect_t *rects, int nrects);
+static void      mj_pipeline_component(mj_jpeg_t *m, int component, const mj_pipeline_component_t *pc, const mj_rect_t *rects, int nrects, mj_pipeline_span_t *spans, JDIMENSION *done);
+static void      mj_pipeline_blocks(const mj_pipeline_component_t *pc, const mj_quanttable_t *qt, mj_quantize_block_fn quantize, JBLOCKROW row, JDIMENSION col_start, JDIMENSION col_end);
+static int       mj_pipeline_spans(mj_jpeg_t *m, int component, const mj_rect_t *rects, int nrects, mj_pipeline_span_t *spans);
+static int       mj_pipeline_compare_spans(const void *a, const void *b);
+static int       mj_pipeline_add(mj_pipeline_t *p, int type, int value0, int value1);
+static void      mj_pipeline_compile(mj_pipeline_t *p, mj_jpeg_t *m, mj_pipeline_component_t *components);
+static void      mj_pipeline_zero(mj_pipeline_component_t *pc);
+static void      mj_pipeline_zero_ac(mj_pipeline_component_t *pc);
+static void      mj_pipeline_add_dc(mj_pipeline_component_t *pc, int value);
+static void      mj_pipeline_scale_dc(mj_pipeline_component_t *pc, int scale);
+static void      mj_pipeline_scale_ac(mj_pipeline_component_t *pc, int scale);
+static int       mj_pipeline_dc(const mj_pipeline_component_t *pc, int value);
+static int       mj_pipeline_factor(int value);
+static long long mj_pipeline_mul(long long value, int scale);
+static long long mj_pipeline_round(long long value);
+static int       mj_pipeline_clamp(long long value, int limit);
 
 int mj_effect_grayscale(mj_jpeg_t *m) {
-    int                  i, c;
-    JDIMENSION           k, l;
-    jpeg_component_info *component;
-    JBLOCKARRAY          blocks;
-    JCOEFPTR             coefs;
+    mj_pipeline_op_t   op = {MJ_PIPELINE_GRAYSCALE, {0, 0}};
+    struct mj_pipeline p = {&op, 1, 1};
 
-    if(m == NULL || m->coef == NULL) {
-        return MJ_ERR_NULL_DATA;
+    return mj_effect_pipeline(m, &p);
+}
+
+int mj_effect_grayscale_rects(mj_jpeg_t *m, const mj_rect_t *rects, int nrects) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_GRAYSCALE, {0, 0}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline_rects(m, &p, rects, nrects);
+}
+
+int mj_effect_pixelate(mj_jpeg_t *m) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_PIXELATE, {0, 0}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline(m, &p);
+}
+
+int mj_effect_pixelate_rects(mj_jpeg_t *m, const mj_rect_t *rects, int nrects) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_PIXELATE, {0, 0}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline_rects(m, &p, rects, nrects);
+}
+
+int mj_effect_tint(mj_jpeg_t *m, int cb_value, int cr_value) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_TINT, {cb_value, cr_value}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline(m, &p);
+}
+
+int mj_effect_tint_rects(mj_jpeg_t *m, int cb_value, int cr_value, const mj_rect_t *rects, int nrects) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_TINT, {cb_value, cr_value}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline_rects(m, &p, rects, nrects);
+}
+
+int mj_effect_luminance(mj_jpeg_t *m, int value) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_LUMINANCE, {value, 0}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline(m, &p);
+}
+
+int mj_effect_luminance_rects(mj_jpeg_t *m, int value, const mj_rect_t *rects, int nrects) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_LUMINANCE, {value, 0}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline_rects(m, &p, rects, nrects);
+}
+
+int mj_effect_contrast(mj_jpeg_t *m, int value) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_CONTRAST, {value, 0}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline(m, &p);
+}
+
+int mj_effect_contrast_rects(mj_jpeg_t *m, int value, const mj_rect_t *rects, int nrects) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_CONTRAST, {value, 0}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline_rects(m, &p, rects, nrects);
+}
+
+int mj_effect_saturation(mj_jpeg_t *m, int value) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_SATURATION, {value, 0}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline(m, &p);
+}
+
+int mj_effect_saturation_rects(mj_jpeg_t *m, int value, const mj_rect_t *rects, int nrects) {
+    mj_pipeline_op_t   op = {MJ_PIPELINE_SATURATION, {value, 0}};
+    struct mj_pipeline p = {&op, 1, 1};
+
+    return mj_effect_pipeline_rects(m, &p, rects, nrects);
+}
+
+mj_pipeline_t *mj_create_pipeline(void) {
+    return (mj_pipeline_t *)calloc(1, sizeof(mj_pipeline_t));
+}
+
+int mj_pipeline_grayscale(mj_pipeline_t *p) {
+    return mj_pipeline_add(p, MJ_PIPELINE_GRAYSCALE, 0, 0);
+}
+
+int mj_pipeline_pixelate(mj_pipeline_t *p) {
+    return mj_pipeline_add(p, MJ_PIPELINE_PIXELATE, 0, 0);
+}
+
+int mj_pipeline_tint(mj_pipeline_t *p, int cb_value, int cr_value) {
+    return mj_pipeline_add(p, MJ_PIPELINE_TINT, cb_value, cr_value);
+}
+
+int mj_pipeline_luminance(mj_pipeline_t *p, int value) {
+    return mj_pipeline_add(p, MJ_PIPELINE_LUMINANCE, value, 0);
+}
+
+int mj_pipeline_contrast(mj_pipeline_t *p, int value) {
+    return mj_pipeline_add(p, MJ_PIPELINE_CONTRAST, value, 0);
+}
+
+int mj_pipeline_saturation(mj_pipeline_t *p, int value) {
+    return mj_pipeline_add(p, MJ_PIPELINE_SATURATION, value, 0);
+}
+
+void mj_free_pipeline(mj_pipeline_t *p) {
+    if(p == NULL) {
+        return;
     }
 
-    if(m->cinfo.jpeg_color_space != JCS_YCbCr) {
-        return MJ_OK;
+    if(p->ops != NULL) {
+        free(p->ops);
     }
 
-    /* set all color components to 0 */
-    for(c = 1; c < m->cinfo.num_components; c++) {
-        component = &m->cinfo.comp_info[c];
+    free(p);
 
-        for(l = 0; l < component->height_in_blocks; l++) {
-            blocks = (*m->cinfo.mem->access_virt_barray)((j_common_ptr)&m->cinfo, m->coef[c], l, 1, TRUE);
+    return;
+}
 
-            for(k = 0; k < component->width_in_blocks; k++) {
-                coefs = blocks[0][k];
+int mj_effect_pipeline(mj_jpeg_t *m, mj_pipeline_t *p) {
+    return mj_pipeline_apply(m, p, NULL, 0);
+}
 
-                for(i = 0; i < DCTSIZE2; i += 8) {
-                    coefs[i + 0] = 0;
-                    coefs[i + 1] = 0;
-                    coefs[i + 2] = 0;
-                    coefs[i + 3] = 0;
-                    coefs[i + 4] = 0;
-                    coefs[i + 5] = 0;
-                    coefs[i + 6] = 0;
-                    coefs[i + 7] = 0;
-                }
-            }
-        }
+int mj_effect_pipeline_rects(mj_jpeg_t *m, mj_pipeline_t *p, const mj_rect_t *rects, int nrects) {
+    if(rects == NULL || nrects < 0) {
+        return MJ_ERR_NULL_DATA;
     }
 
-    return MJ_OK;
+    return mj_pipeline_apply(m, p, rects, nrects);
 }
 
-int mj_effect_pixelate(mj_jpeg_t *m) {
-    int                  i, c;
-    JDIMENSION           k, l;
-    jpeg_component_info *component;
-    JBLOCKARRAY          blocks;
-    JCOEFPTR             coefs;
+static int mj_pipeline_apply(mj_jpeg_t *m, mj_pipeline_t *p, const mj_rect_t *rects, int nrects) {
+    // applies the pipeline to the whole image if rects is NULL, to the blocks that the rectangles cover otherwise
+    int                     c;
+    mj_pipeline_component_t components[MAX_COMPONENTS];
+    mj_pipeline_span_t *    spans = NULL;
+    JDIMENSION *            done = NULL;
+    JDIMENSION              nrows = 0;
 
-    if(m == NULL || m->coef == NULL) {
+    if(m == NULL || m->coef == NULL || p == NULL) {
         return MJ_ERR_NULL_DATA;
     }
 
-    /* Set all the AC coefficients to 0 */
-    for(c = 0; c < m->cinfo.num_components; c++) {
-        component = &m->cinfo.comp_info[c];
-
-        for(l = 0; l < component->height_in_blocks; l++) {
-            blocks = (*m->cinfo.mem->access_virt_barray)((j_common_ptr)&m->cinfo, m->coef[c], l, 1, TRUE);
-
-            for(k = 0; k < component->width_in_blocks; k++) {
-                coefs = blocks[0][k];
-
-                coefs[1] = 0;
-                coefs[2] = 0;
-                coefs[3] = 0;
-                coefs[4] = 0;
-                coefs[5] = 0;
-                coefs[6] = 0;
-                coefs[7] = 0;
-
-                for(i = 8; i < DCTSIZE2; i += 8) {
-                    coefs[i + 0] = 0;
-                    coefs[i + 1] = 0;
-                    coefs[i + 2] = 0;
-                    coefs[i + 3] = 0;
-                    coefs[i + 4] = 0;
-                    coefs[i + 5] = 0;
-                    coefs[i + 6] = 0;
-                    coefs[i + 7] = 0;
-                }
+    if(rects != NULL) {
+        if(nrects == 0) {
+            return MJ_OK;
+        }
+
+        for(c = 0; c < m->cinfo.num_components; c++) {
+            if(m->cinfo.comp_info[c].height_in_blocks > nrows) {
+                nrows = m->cinfo.comp_info[c].height_in_blocks;
             }
         }
+
+        spans = (mj_pipeline_span_t *)malloc(nrects * sizeof(mj_pipeline_span_t));
+        done = (JDIMENSION *)malloc(nrows * sizeof(JDIMENSION));
+        if(spans == NULL || done == NULL) {
+            free(spans);
+            free(done);
+            return MJ_ERR_MEMORY;
+        }
+    }
+
+    // all ops are combined into one change per component, such that every block is
+    // only visited, dequantized and quantized once
+    mj_pipeline_compile(p, m, components);
+
+    for(c = 0; c < m->cinfo.num_components; c++) {
+        if(components[c].modified == 0) {
+            continue;
+        }
+
+        mj_pipeline_component(m, c, &components[c], rects, nrects, spans, done);
+    }
+
+    if(spans != NULL) {
+        free(spans);
+        free(done);
     }
 
     return MJ_OK;
 }
 
-int mj_effect_tint(mj_jpeg_t *m, int cb_value, int cr_value) {
-    JDIMENSION           k, l;
-    jpeg_component_info *component;
+static void mj_pipeline_component(mj_jpeg_t *m, int component, const mj_pipeline_component_t *pc, const mj_rect_t *rects, int nrects, mj_pipeline_span_t *spans, JDIMENSION *done) {
+    jpeg_component_info *comp = &m->cinfo.comp_info[component];
+    mj_quanttable_t *    qt = &m->quant[component];
+    mj_quantize_block_fn quantize = mj_get_quantize_block();
     JBLOCKARRAY          blocks;
-    JCOEFPTR             coefs;
+    JDIMENSION           l, l_start, l_end, col_start;
+    int                  i, n, nspans;
 
-    if(m == NULL || m->coef == NULL) {
-        return MJ_ERR_NULL_DATA;
+    mj_get_block_rows(m, component, &l_start, &l_end);
+
+    if(rects == NULL) {
+        mj_splice_mark(m, component, (int)l_start, (int)l_end, 0, (int)comp->width_in_blocks);
+
+        for(l = l_start; l < l_end; l++) {
+            blocks = (*m->cinfo.mem->access_virt_barray)((j_common_ptr)&m->cinfo, m->coef[component], l, 1, TRUE);
+            mj_pipeline_blocks(pc, qt, quantize, blocks[0], 0, comp->width_in_blocks);
+        }
+
+        return;
     }
 
-    if(m->cinfo.jpeg_color_space != JCS_YCbCr) {
-        return MJ_OK;
+    nspans = mj_pipeline_spans(m, component, rects, nrects, spans);
+
+    // only the spans that are left in the rows of the band are kept
+    for(i = 0, n = 0; i < nspans; i++) {
+        if(spans[i].row_start < l_start) {
+            spans[i].row_start = l_start;
+        }
+
+        if(spans[i].row_end > l_end) {
+            spans[i].row_end = l_end;
+        }
+
+        if(spans[i].row_start >= spans[i].row_end) {
+            continue;
+        }
+
+        mj_splice_mark(m, component, (int)spans[i].row_start, (int)spans[i].row_end, (int)spans[i].col_start, (int)spans[i].col_end);
+
+        spans[n++] = spans[i];
     }
 
-    if(cb_value == 0 && cr_value == 0) {
-        return MJ_OK;
+    if(n == 0) {
+        return;
     }
 
-    if(cb_value != 0) {
-        component = &m->cinfo.comp_info[1];
+    // the spans are sorted by their first column. done[l] is the column up to which the blocks of row l that the spans
+    // before cover have been changed, such that blocks in overlapping spans are only changed once. only the rows of
+    // a span are visited.
+    memset(&done[l_start], 0, (l_end - l_start) * sizeof(JDIMENSION));
 
-        for(l = 0; l < component->height_in_blocks; l++) {
-            blocks = (*m->cinfo.mem->access_virt_barray)((j_common_ptr)&m->cinfo, m->coef[1], l, 1, TRUE);
+    for(i = 0; i < n; i++) {
+        for(l = spans[i].row_start; l < spans[i].row_end; l++) {
+            if(spans[i].col_end <= done[l]) {
+                continue;
+            }
 
-            for(k = 0; k < component->width_in_blocks; k++) {
-                coefs = blocks[0][k];
+            col_start = spans[i].col_start > done[l] ? spans[i].col_start : done[l];
 
-                coefs[0] *= component->quant_table->quantval[0];
-                coefs[0] += cb_value;
+            blocks = (*m->cinfo.mem->access_virt_barray)((j_common_ptr)&m->cinfo, m->coef[component], l, 1, TRUE);
+            mj_pipeline_blocks(pc, qt, quantize, blocks[0], col_start, spans[i].col_end);
 
-                if(coefs[0] > 2047) {
-                    coefs[0] = 2047;
-                }
-                else if(coefs[0] < -2047) {
-                    coefs[0] = -2047;
+            done[l] = spans[i].col_end;
+        }
+    }
+
+    return;
+}
+
+static void mj_pipeline_blocks(const mj_pipeline_component_t *pc, const mj_quanttable_t *qt, mj_quantize_block_fn quantize, JBLOCKROW row, JDIMENSION col_start, JDIMENSION col_end) {
+    int        i;
+    int        values[DCTSIZE2];
+    JDIMENSION k;
+    JCOEFPTR   coefs;
+
+    for(k = col_start; k < col_end; k++) {
+        coefs = row[k];
+
+        // scaled AC coefficients need the whole block
+        if(pc->ac != 0 && pc->ac_scale != 0) {
+            mj_dequantize_block(qt, coefs, values);
+
+            if(pc->dc != 0) {
+                values[0] = mj_pipeline_dc(pc, values[0]);
+            }
+
+            for(i = 1; i < DCTSIZE2; i++) {
+                if(values[i] == 0) {
+                    continue;
                 }
 
-                coefs[0] /= component->quant_table->quantval[0];
+                values[i] = mj_pipeline_clamp(mj_pipeline_mul(values[i], pc->ac_scale), MJ_PIPELINE_MAX_AC);
             }
+
+            quantize(qt, values, coefs);
+
+            continue;
+        }
+
+        if(pc->dc != 0) {
+            coefs[0] = (JCOEF)mj_quantize_value(qt, 0, mj_pipeline_dc(pc, coefs[0] * qt->quantval[0]));
+        }
+
+        if(pc->ac != 0) {
+            memset(&coefs[1], 0, (DCTSIZE2 - 1) * sizeof(JCOEF));
         }
     }
 
-    if(cr_value != 0) {
-        component = &m->cinfo.comp_info[2];
+    return;
+}
 
-        for(l = 0; l < component->height_in_blocks; l++) {
-            blocks = (*m->cinfo.mem->access_virt_barray)((j_common_ptr)&m->cinfo, m->coef[2], l, 1, TRUE);
+static int mj_pipeline_spans(mj_jpeg_t *m, int component, const mj_rect_t *rects, int nrects, mj_pipeline_span_t *spans) {
+    // maps the rectangles in pixels to the blocks of the component that they touch, sorted by their first column
+    jpeg_component_info *comp = &m->cinfo.comp_info[component];
+    long long            x0, y0, x1, y1;
+    int                  i, nspans = 0;
 
-            for(k = 0; k < component->width_in_blocks; k++) {
-                coefs = blocks[0][k];
+    for(i = 0; i < nrects; i++) {
+        if(rects[i].width <= 0 || rects[i].height <= 0) {
+            continue;
+        }
 
-                coefs[0] *= component->quant_table->quantval[0];
-                coefs[0] += cr_value;
+        x0 = rects[i].x < 0 ? 0 : rects[i].x;
+        y0 = rects[i].y < 0 ? 0 : rects[i].y;
+        x1 = (long long)rects[i].x + rects[i].width;
+        y1 = (long long)rects[i].y + rects[i].height;
 
-                if(coefs[0] > 2047) {
-                    coefs[0] = 2047;
-                }
-                else if(coefs[0] < -2047) {
-                    coefs[0] = -2047;
-                }
+        if(x1 > m->width) {
+            x1 = m->width;
+        }
 
-                coefs[0] /= component->quant_table->quantval[0];
-            }
+        if(y1 > m->height) {
+            y1 = m->height;
+        }
+
+        if(x0 >= x1 || y0 >= y1) {
+            continue;
         }
+
+        spans[nspans].col_start = (JDIMENSION)(x0 * comp->h_samp_factor / m->sampling.h_factor);
+        spans[nspans].col_end = (JDIMENSION)((x1 * comp->h_samp_factor + m->sampling.h_factor - 1) / m->sampling.h_factor);
+        spans[nspans].row_start = (JDIMENSION)(y0 * comp->v_samp_factor / m->sampling.v_factor);
+        spans[nspans].row_end = (JDIMENSION)((y1 * comp->v_samp_factor + m->sampling.v_factor - 1) / m->sampling.v_factor);
+
+        if(spans[nspans].col_end > comp->width_in_blocks) {
+            spans[nspans].col_end = comp->width_in_blocks;
+        }
+
+        if(spans[nspans].row_end > comp->height_in_blocks) {
+            spans[nspans].row_end = comp->height_in_blocks;
+        }
+
+        nspans++;
     }
 
-    return MJ_OK;
+    qsort(spans, nspans, sizeof(mj_pipeline_span_t), mj_pipeline_compare_spans);
+
+    return nspans;
 }
 
-int mj_effect_luminance(mj_jpeg_t *m, int value) {
-    JDIMENSION           k, l;
-    jpeg_component_info *component;
-    JBLOCKARRAY          blocks;
-    JCOEFPTR             coefs;
+static int mj_pipeline_compare_spans(const void *a, const void *b) {
+    const mj_pipeline_span_t *sa = (const mj_pipeline_span_t *)a;
+    const mj_pipeline_span_t *sb = (const mj_pipeline_span_t *)b;
 
-    if(m == NULL || m->coef == NULL) {
+    if(sa->col_start < sb->col_start) {
+        return -1;
+    }
+
+    if(sa->col_start > sb->col_start) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static int mj_pipeline_add(mj_pipeline_t *p, int type, int value0, int value1) {
+    if(p == NULL) {
         return MJ_ERR_NULL_DATA;
     }
 
-    if(m->cinfo.jpeg_color_space != JCS_YCbCr) {
-        return MJ_OK;
+    if(p->nops == p->size) {
+        int               size = p->size == 0 ? 4 : 2 * p->size;
+        mj_pipeline_op_t *ops = (mj_pipeline_op_t *)realloc(p->ops, size * sizeof(mj_pipeline_op_t));
+        if(ops == NULL) {
+            return MJ_ERR_MEMORY;
+        }
+
+        p->ops = ops;
+        p->size = size;
     }
 
-    component = &m->cinfo.comp_info[0];
+    p->ops[p->nops].type = type;
+    p->ops[p->nops].value[0] = value0;
+    p->ops[p->nops].value[1] = value1;
+    p->nops++;
 
-    for(l = 0; l < component->height_in_blocks; l++) {
-        blocks = (*m->cinfo.mem->access_virt_barray)((j_common_ptr)&m->cinfo, m->coef[0], l, 1, TRUE);
+    return MJ_OK;
+}
 
-        for(k = 0; k < component->width_in_blocks; k++) {
-            coefs = blocks[0][k];
+static void mj_pipeline_compile(mj_pipeline_t *p, mj_jpeg_t *m, mj_pipeline_component_t *components) {
+    int               i, c, scale;
+    int               ycbcr = (m->cinfo.jpeg_color_space == JCS_YCbCr);
+    int               gray = (m->cinfo.jpeg_color_space == JCS_GRAYSCALE);
+    mj_pipeline_op_t *op;
 
-            coefs[0] *= component->quant_table->quantval[0];
-            coefs[0] += value;
+    memset(components, 0, MAX_COMPONENTS * sizeof(mj_pipeline_component_t));
 
-            if(coefs[0] > 2047) {
-                coefs[0] = 2047;
-            }
-            else if(coefs[0] < -2047) {
-                coefs[0] = -2047;
-            }
+    for(i = 0; i < p->nops; i++) {
+        op = &p->ops[i];
+
+        switch(op->type) {
+            case MJ_PIPELINE_GRAYSCALE:
+                // set all color components to 0
+                if(ycbcr == 0) {
+                    break;
+                }
 
-            coefs[0] /= component->quant_table->quantval[0];
+                for(c = 1; c < m->cinfo.num_components; c++) {
+                    mj_pipeline_zero(&components[c]);
+                }
+                break;
+            case MJ_PIPELINE_PIXELATE:
+                // set all the AC coefficients to 0
+                for(c = 0; c < m->cinfo.num_components; c++) {
+                    mj_pipeline_zero_ac(&components[c]);
+                }
+                break;
+            case MJ_PIPELINE_TINT:
+                if(ycbcr == 0) {
+                    break;
+                }
+
+                if(op->value[0] != 0) {
+                    mj_pipeline_add_dc(&components[1], op->value[0]);
+                }
+
+                if(op->value[1] != 0) {
+                    mj_pipeline_add_dc(&components[2], op->value[1]);
+                }
+                break;
+            case MJ_PIPELINE_LUMINANCE:
+                if(ycbcr == 0) {
+                    break;
+                }
+
+                mj_pipeline_add_dc(&components[0], op->value[0]);
+                break;
+            case MJ_PIPELINE_CONTRAST:
+                // the luminance is level shifted, i.e. scaling all its coefficients scales the
+                // distance of the samples to the middle gray
+                if((ycbcr == 0 && gray == 0) || op->value[0] == 0) {
+                    break;
+                }
+
+                scale = mj_pipeline_factor(op->value[0]);
+
+                mj_pipeline_scale_dc(&components[0], scale);
+                mj_pipeline_scale_ac(&components[0], scale);
+                break;
+            case MJ_PIPELINE_SATURATION:
+                // the chroma is 0 for gray, i.e. scaling all coefficients scales the distance to gray
+                if(ycbcr == 0 || op->value[0] == 0) {
+                    break;
+                }
+
+                scale = mj_pipeline_factor(op->value[0]);
+
+                for(c = 1; c < m->cinfo.num_components; c++) {
+                    mj_pipeline_scale_dc(&components[c], scale);
+                    mj_pipeline_scale_ac(&components[c], scale);
+                }
+                break;
+            default:
+                break;
         }
     }
 
-    return MJ_OK;
+    return;
+}
+
+static void mj_pipeline_zero(mj_pipeline_component_t *pc) {
+    pc->modified = 1;
+
+    pc->dc = 1;
+    pc->dc_scale = 0;
+    pc->dc_offset = 0;
+    pc->dc_min = 0;
+    pc->dc_max = 0;
+
+    mj_pipeline_zero_ac(pc);
+
+    return;
+}
+
+static void mj_pipeline_zero_ac(mj_pipeline_component_t *pc) {
+    pc->modified = 1;
+
+    pc->ac = 1;
+    pc->ac_scale = 0;
+
+    return;
+}
+
+static void mj_pipeline_add_dc(mj_pipeline_component_t *pc, int value) {
+    pc->modified = 1;
+
+    if(pc->dc == 0) {
+        pc->dc = 1;
+        pc->dc_scale = MJ_PIPELINE_ONE;
+        pc->dc_offset = (long long)value * MJ_PIPELINE_ONE;
+        pc->dc_min = -MJ_PIPELINE_MAX_DC;
+        pc->dc_max = MJ_PIPELINE_MAX_DC;
+
+        return;
+    }
+
+    // adding to a clamped value is the same as adding to the value and to the bounds
+    pc->dc_offset += (long long)value * MJ_PIPELINE_ONE;
+    pc->dc_min = mj_pipeline_clamp((long long)pc->dc_min + value, MJ_PIPELINE_MAX_DC);
+    pc->dc_max = mj_pipeline_clamp((long long)pc->dc_max + value, MJ_PIPELINE_MAX_DC);
+
+    return;
+}
+
+static void mj_pipeline_scale_dc(mj_pipeline_component_t *pc, int scale) {
+    pc->modified = 1;
+
+    if(pc->dc == 0) {
+        pc->dc = 1;
+        pc->dc_scale = scale;
+        pc->dc_offset = 0;
+        pc->dc_min = -MJ_PIPELINE_MAX_DC;
+        pc->dc_max = MJ_PIPELINE_MAX_DC;
+
+        return;
+    }
+
+    // the same for scaling with a positive factor
+    pc->dc_scale = mj_pipeline_clamp(mj_pipeline_mul(pc->dc_scale, scale), MJ_PIPELINE_MAX_SCALE);
+    pc->dc_offset = mj_pipeline_mul(pc->dc_offset, scale);
+    pc->dc_min = mj_pipeline_clamp(mj_pipeline_mul(pc->dc_min, scale), MJ_PIPELINE_MAX_DC);
+    pc->dc_max = mj_pipeline_clamp(mj_pipeline_mul(pc->dc_max, scale), MJ_PIPELINE_MAX_DC);
+
+    return;
+}
+
+static void mj_pipeline_scale_ac(mj_pipeline_component_t *pc, int scale) {
+    pc->modified = 1;
+
+    if(pc->ac == 0) {
+        pc->ac = 1;
+        pc->ac_scale = scale;
+
+        return;
+    }
+
+    pc->ac_scale = mj_pipeline_clamp(mj_pipeline_mul(pc->ac_scale, scale), MJ_PIPELINE_MAX_SCALE);
+
+    return;
+}
+
+static int mj_pipeline_dc(const mj_pipeline_component_t *pc, int value) {
+    long long dc = mj_pipeline_round((long long)value * pc->dc_scale + pc->dc_offset);
+
+    if(dc > pc->dc_max) {
+        return pc->dc_max;
+    }
+    else if(dc < pc->dc_min) {
+        return pc->dc_min;
+    }
+
+    return (int)dc;
+}
+
+static int mj_pipeline_factor(int value) {
+    // a value in percent, -100 removes the contrast or the colors
+    if(value < -100) {
+        value = -100;
+    }
+    else if(value > 1000) {
+        value = 1000;
+    }
+
+    return (int)(((long long)(100 + value) * MJ_PIPELINE_ONE) / 100);
+}
+
+static long long mj_pipeline_mul(long long value, int scale) {
+    // value * scale with scale in 16.16 fixed point. the value is saturated far beyond any coefficient.
+    long long limit = 1LL << 42;
+
+    if(value > limit) {
+        value = limit;
+    }
+    else if(value < -limit) {
+        value = -limit;
+    }
+
+    return mj_pipeline_round(value * scale);
+}
+
+static long long mj_pipeline_round(long long value) {
+    // from 16.16 fixed point, rounded half away from zero
+    if(value < 0) {
+        return -((-value + MJ_PIPELINE_ONE / 2) >> 16);
+    }
+
+    return (value + MJ_PIPELINE_ONE / 2) >> 16;
+}
+
+static int mj_pipeline_clamp(long long value, int limit) {
+    if(value > limit) {
+        return limit;
+    }
+    else if(value < -limit) {
+        return -limit;
+    }
+
+    return (int)value;
 }
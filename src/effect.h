@@ -23,4 +23,51 @@
 #ifndef _LIBMODJPEG_EFFECT_H_
 #define _LIBMODJPEG_EFFECT_H_
 
+#include "libmodjpeg.h"
+
+#define MJ_PIPELINE_GRAYSCALE  1
+#define MJ_PIPELINE_PIXELATE   2
+#define MJ_PIPELINE_TINT       3
+#define MJ_PIPELINE_LUMINANCE  4
+#define MJ_PIPELINE_CONTRAST   5
+#define MJ_PIPELINE_SATURATION 6
+
+// the scale factors of a pipeline are 16.16 fixed point
+#define MJ_PIPELINE_ONE (1 << 16)
+
+typedef struct {
+    int type;
+    int value[2];
+} mj_pipeline_op_t;
+
+struct mj_pipeline {
+    mj_pipeline_op_t *ops;
+    int               nops;
+    int               size;    // the number of ops that fit into the array
+};
+
+// what the ops of a pipeline do to the blocks of one component. the dequantized DC coefficient x
+// becomes min(max(x * dc_scale + dc_offset, dc_min), dc_max), the dequantized AC coefficients are
+// multiplied by ac_scale.
+typedef struct {
+    int modified;
+
+    int       dc;    // whether the DC coefficient is changed
+    int       dc_scale;
+    long long dc_offset;
+    int       dc_min;
+    int       dc_max;
+
+    int ac;    // whether the AC coefficients are changed
+    int ac_scale;
+} mj_pipeline_component_t;
+
+// the blocks [row_start, row_end) x [col_start, col_end) of a component that a rectangle covers
+typedef struct {
+    JDIMENSION row_start;
+    JDIMENSION row_end;
+    JDIMENSION col_start;
+    JDIMENSION col_end;
+} mj_pipeline_span_t;
+
 #endif
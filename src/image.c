@@ -22,13 +22,22 @@
 
 #include "image.h"
 
+#include "arena.h"
 #include "jpeg.h"
 #include "libmodjpeg.h"
+#include "marker.h"
+#include "quant.h"
+#include "splice.h"
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+static int mj_is_full_luminance(struct jpeg_compress_struct *cinfo);
 
 int mj_read_jpeg_from_memory(mj_jpeg_t *m, const unsigned char *memory, size_t len, size_t max_pixel) {
     if(m == NULL) {
@@ -48,10 +57,12 @@ int mj_read_jpeg_from_memory(mj_jpeg_t *m, const unsigned char *memory, size_t l
     jerr.pub.error_exit = mj_jpeg_error_exit;
     if(setjmp(jerr.setjmp_buffer)) {
         jpeg_destroy_decompress(&m->cinfo);
+        mj_splice_free(m);
         return MJ_ERR_DECODE_JPEG;
     }
 
     jpeg_create_decompress(&m->cinfo);
+    mj_arena_attach(m->arena, (j_common_ptr)&m->cinfo);
 
     m->cinfo.src = &src.pub;
     src.pub.init_source = mj_jpeg_init_source;
@@ -63,21 +74,27 @@ int mj_read_jpeg_from_memory(mj_jpeg_t *m, const unsigned char *memory, size_t l
     src.buf = (JOCTET *)memory;
     src.size = len;
 
-    // save markers (must happen before jpeg_read_header)
-    jpeg_save_markers(&m->cinfo, JPEG_COM, 0xFFFF);
-
-    int i = 0;
-    for(i = 0; i < 16; i++) {
-        jpeg_save_markers(&m->cinfo, JPEG_APP0 + i, 0xFFFF);
+    int rv = mj_read_jpeg(m, memory, len, max_pixel);
+    if(rv != MJ_OK) {
+        jpeg_destroy_decompress(&m->cinfo);
+        mj_splice_free(m);
     }
 
+    return rv;
+}
+
+int mj_read_jpeg(mj_jpeg_t *m, const unsigned char *memory, size_t len, size_t max_pixel) {
+    // reads the JPEG from the source of the decompress object. memory holds the same JPEG for MJ_OPTION_SPLICE.
+
+    // save markers (must happen before jpeg_read_header)
+    mj_save_markers(&m->cinfo, m->markers);
+
     jpeg_read_header(&m->cinfo, TRUE);
 
     m->width = m->cinfo.image_width;
     m->height = m->cinfo.image_height;
 
     if(max_pixel != 0 && ((size_t)m->width * (size_t)m->height) > max_pixel) {
-        jpeg_destroy_decompress(&m->cinfo);
         return MJ_ERR_IMAGE_SIZE;
     }
 
@@ -87,11 +104,30 @@ int mj_read_jpeg_from_memory(mj_jpeg_t *m, const unsigned char *memory, size_t l
         case JCS_YCbCr:
             break;
         default:
-            jpeg_destroy_decompress(&m->cinfo);
             return MJ_ERR_UNSUPPORTED_COLORSPACE;
     }
 
+    // keep the original for MJ_OPTION_SPLICE if it has been asked for. the entropy-coded data starts right after the SOS
+    // marker. without the original, e.g. if there's not enough memory for it, the whole image is encoded.
+    if(m->splice != 0) {
+        mj_splice_init(m, memory, len, len - m->cinfo.src->bytes_in_buffer);
+    }
+
     m->coef = jpeg_read_coefficients(&m->cinfo);
+    m->len = len;
+
+    mj_setup_jpeg(m);
+
+    return MJ_OK;
+}
+
+void mj_setup_jpeg(mj_jpeg_t *m) {
+    // the quantization tables of the components are only known after the decoding started
+    int                  c;
+    jpeg_component_info *component;
+
+    m->width = m->cinfo.image_width;
+    m->height = m->cinfo.image_height;
 
     m->sampling.max_h_samp_factor = m->cinfo.max_h_samp_factor;
     m->sampling.max_v_samp_factor = m->cinfo.max_v_samp_factor;
@@ -99,251 +135,594 @@ int mj_read_jpeg_from_memory(mj_jpeg_t *m, const unsigned char *memory, size_t l
     m->sampling.h_factor = (m->sampling.max_h_samp_factor * DCTSIZE);
     m->sampling.v_factor = (m->sampling.max_v_samp_factor * DCTSIZE);
 
-    int                  c;
-    jpeg_component_info *component;
-
     for(c = 0; c < m->cinfo.num_components; c++) {
         component = &m->cinfo.comp_info[c];
 
         m->sampling.samp_factor[c].h_samp_factor = component->h_samp_factor;
         m->sampling.samp_factor[c].v_samp_factor = component->v_samp_factor;
+
+        mj_init_quanttable(&m->quant[c], component->quant_table);
+    }
+
+    return;
+}
+
+int mj_derive_jpeg(mj_jpeg_t *dst, mj_jpeg_t *src, JDIMENSION width, JDIMENSION height) {
+    // the decompress object of dst looks like it has read a JPEG of width x height pixels with the same components,
+    // quantization tables and markers as src. the coefficients are all 0. on error, dst must be free'd.
+    struct mj_jpeg_error_mgr jerr;
+    jpeg_component_info *    incomp, *outcomp;
+    JQUANT_TBL *             table;
+    int                      c, i;
+
+    dst->cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = mj_jpeg_error_exit;
+    if(setjmp(jerr.setjmp_buffer)) {
+        return MJ_ERR_MEMORY;
+    }
+
+    jpeg_create_decompress(&dst->cinfo);
+    mj_arena_attach(dst->arena, (j_common_ptr)&dst->cinfo);
+
+    dst->cinfo.image_width = width;
+    dst->cinfo.image_height = height;
+    dst->cinfo.num_components = src->cinfo.num_components;
+    dst->cinfo.jpeg_color_space = src->cinfo.jpeg_color_space;
+    dst->cinfo.data_precision = src->cinfo.data_precision;
+    dst->cinfo.CCIR601_sampling = src->cinfo.CCIR601_sampling;
+
+    dst->cinfo.saw_JFIF_marker = src->cinfo.saw_JFIF_marker;
+    dst->cinfo.JFIF_major_version = src->cinfo.JFIF_major_version;
+    dst->cinfo.JFIF_minor_version = src->cinfo.JFIF_minor_version;
+    dst->cinfo.density_unit = src->cinfo.density_unit;
+    dst->cinfo.X_density = src->cinfo.X_density;
+    dst->cinfo.Y_density = src->cinfo.Y_density;
+    dst->cinfo.saw_Adobe_marker = src->cinfo.saw_Adobe_marker;
+    dst->cinfo.Adobe_transform = src->cinfo.Adobe_transform;
+
+    dst->cinfo.max_h_samp_factor = src->cinfo.max_h_samp_factor;
+    dst->cinfo.max_v_samp_factor = src->cinfo.max_v_samp_factor;
+
+    for(i = 0; i < NUM_QUANT_TBLS; i++) {
+        if(src->cinfo.quant_tbl_ptrs[i] == NULL) {
+            continue;
+        }
+
+        table = jpeg_alloc_quant_table((j_common_ptr)&dst->cinfo);
+        memcpy(table->quantval, src->cinfo.quant_tbl_ptrs[i]->quantval, sizeof(table->quantval));
+        dst->cinfo.quant_tbl_ptrs[i] = table;
     }
 
+    dst->cinfo.comp_info = (jpeg_component_info *)(*dst->cinfo.mem->alloc_small)((j_common_ptr)&dst->cinfo, JPOOL_IMAGE, dst->cinfo.num_components * sizeof(jpeg_component_info));
+    memset(dst->cinfo.comp_info, 0, dst->cinfo.num_components * sizeof(jpeg_component_info));
+
+    dst->coef = (jvirt_barray_ptr *)(*dst->cinfo.mem->alloc_small)((j_common_ptr)&dst->cinfo, JPOOL_IMAGE, dst->cinfo.num_components * sizeof(jvirt_barray_ptr));
+
+    for(c = 0; c < dst->cinfo.num_components; c++) {
+        incomp = &src->cinfo.comp_info[c];
+        outcomp = &dst->cinfo.comp_info[c];
+
+        outcomp->component_id = incomp->component_id;
+        outcomp->component_index = c;
+        outcomp->h_samp_factor = incomp->h_samp_factor;
+        outcomp->v_samp_factor = incomp->v_samp_factor;
+        outcomp->quant_tbl_no = incomp->quant_tbl_no;
+        outcomp->dc_tbl_no = incomp->dc_tbl_no;
+        outcomp->ac_tbl_no = incomp->ac_tbl_no;
+        outcomp->component_needed = TRUE;
+
+        // the same as jdinput.c does for a JPEG of this size
+        outcomp->width_in_blocks = (dst->cinfo.image_width * outcomp->h_samp_factor + dst->cinfo.max_h_samp_factor * DCTSIZE - 1) / (dst->cinfo.max_h_samp_factor * DCTSIZE);
+        outcomp->height_in_blocks = (dst->cinfo.image_height * outcomp->v_samp_factor + dst->cinfo.max_v_samp_factor * DCTSIZE - 1) / (dst->cinfo.max_v_samp_factor * DCTSIZE);
+        outcomp->downsampled_width = (dst->cinfo.image_width * outcomp->h_samp_factor + dst->cinfo.max_h_samp_factor - 1) / dst->cinfo.max_h_samp_factor;
+        outcomp->downsampled_height = (dst->cinfo.image_height * outcomp->v_samp_factor + dst->cinfo.max_v_samp_factor - 1) / dst->cinfo.max_v_samp_factor;
+
+        if(incomp->quant_table != NULL) {
+            table = jpeg_alloc_quant_table((j_common_ptr)&dst->cinfo);
+            memcpy(table->quantval, incomp->quant_table->quantval, sizeof(table->quantval));
+            outcomp->quant_table = table;
+        }
+
+        // the encoder reads whole iMCUs, the arrays are padded like the ones of jpeg_read_coefficients()
+        dst->coef[c] = (*dst->cinfo.mem->request_virt_barray)((j_common_ptr)&dst->cinfo, JPOOL_IMAGE, TRUE,
+                                                               (outcomp->width_in_blocks + outcomp->h_samp_factor - 1) / outcomp->h_samp_factor * outcomp->h_samp_factor,
+                                                               (outcomp->height_in_blocks + outcomp->v_samp_factor - 1) / outcomp->v_samp_factor * outcomp->v_samp_factor,
+                                                               outcomp->v_samp_factor);
+    }
+
+    (*dst->cinfo.mem->realize_virt_arrays)((j_common_ptr)&dst->cinfo);
+
+    mj_copy_markers(&dst->cinfo, &src->cinfo);
+
+    mj_setup_jpeg(dst);
+
     return MJ_OK;
 }
 
+void mj_get_block_rows(mj_jpeg_t *m, int component, JDIMENSION *start, JDIMENSION *end) {
+    // while streaming only the rows of blocks of the current band are accessible
+    jpeg_component_info *comp = &m->cinfo.comp_info[component];
+
+    *start = 0;
+    *end = comp->height_in_blocks;
+
+    if(m->band_end == 0) {
+        return;
+    }
+
+    *start = (JDIMENSION)m->band_start * comp->v_samp_factor;
+    if((JDIMENSION)m->band_end * comp->v_samp_factor < *end) {
+        *end = (JDIMENSION)m->band_end * comp->v_samp_factor;
+    }
+
+    if(*start > *end) {
+        *start = *end;
+    }
+
+    return;
+}
+
 int mj_read_jpeg_from_file(mj_jpeg_t *m, const char *filename, size_t max_pixel) {
     if(m == NULL) {
         return MJ_ERR_NULL_DATA;
     }
 
-    int            rv;
-    unsigned char *buffer;
-    size_t         len;
+    int       rv;
+    mj_file_t f;
 
-    rv = mj_read_file(&buffer, &len, filename);
+    rv = mj_map_file(&f, filename);
     if(rv != MJ_OK) {
         return rv;
     }
 
-    rv = mj_read_jpeg_from_memory(m, buffer, len, max_pixel);
+    rv = mj_read_jpeg_from_memory(m, f.data, f.len, max_pixel);
 
-    free(buffer);
+    mj_unmap_file(&f);
 
     return rv;
 }
 
-int mj_write_jpeg_to_memory(mj_jpeg_t *m, unsigned char **memory, size_t *len, int options) {
-    if(m == NULL) {
+int mj_probe_jpeg(mj_probe_t *p, const unsigned char *memory, size_t len) {
+    if(p == NULL) {
         return MJ_ERR_NULL_DATA;
     }
 
-    struct jpeg_compress_struct cinfo;
-    jvirt_barray_ptr *          dst_coef_arrays;
-    struct mj_jpeg_error_mgr    jerr;
-    struct mj_jpeg_dest_mgr     dest;
-    char                        jpegerrorbuffer[JMSG_LENGTH_MAX];
+    if(memory == NULL || len < 2) {
+        return MJ_ERR_NULL_DATA;
+    }
 
-    cinfo.err = jpeg_std_error(&jerr.pub);
-    jerr.pub.error_exit = mj_jpeg_error_exit;
-    if(setjmp(jerr.setjmp_buffer)) {
-        (*cinfo.err->format_message)((j_common_ptr)&cinfo, jpegerrorbuffer);
-        jpeg_destroy_compress(&cinfo);
-        if(dest.buf != NULL) {
-            free(dest.buf);
-        }
+    memset(p, 0, sizeof(mj_probe_t));
 
-        return MJ_ERR_ENCODE_JPEG;
+    if(memory[0] != 0xFF || memory[1] != 0xD8) {    // SOI
+        return MJ_ERR_DECODE_JPEG;
     }
 
-    jpeg_create_compress(&cinfo);
+    const unsigned char *data;
+    size_t               pos = 2, length;
+    int                  marker, c, h, v;
+    int                  ids[MAX_COMPONENTS];
+    int                  jfif = 0, transform = -1, sof = 0;
 
-    cinfo.dest = &dest.pub;
-    dest.buf = NULL;
-    dest.size = 0;
-    dest.pub.init_destination = mj_jpeg_init_destination;
-    dest.pub.empty_output_buffer = mj_jpeg_empty_output_buffer;
-    dest.pub.term_destination = mj_jpeg_term_destination;
+    // walk the marker segments up to the first scan. the data may end anywhere after the frame header.
+    while(pos + 4 <= len) {
+        if(memory[pos] != 0xFF) {
+            return MJ_ERR_DECODE_JPEG;
+        }
 
-    jpeg_copy_critical_parameters(&m->cinfo, &cinfo);
+        // a marker can be preceded by any number of fill bytes
+        while(pos + 1 < len && memory[pos + 1] == 0xFF) {
+            pos++;
+        }
 
-    if((options & MJ_OPTION_OPTIMIZE) != 0) {
-        cinfo.optimize_coding = TRUE;
-    }
-    else {
-        cinfo.optimize_coding = FALSE;
-    }
+        if(pos + 4 > len) {
+            break;
+        }
 
-    if((options & MJ_OPTION_PROGRESSIVE) != 0) {
-        jpeg_simple_progression(&cinfo);
-    }
-    else {
-        cinfo.scan_info = NULL;
-    }
+        marker = memory[pos + 1];
 
-    if((options & MJ_OPTION_ARITHMETRIC) != 0) {
-        cinfo.arith_code = TRUE;
-    }
-    else {
-        cinfo.arith_code = FALSE;
-    }
+        // markers without a segment
+        if(marker == 0xD8 || (marker >= JPEG_RST0 && marker <= JPEG_RST0 + 7) || marker == 0x01) {
+            pos += 2;
+            continue;
+        }
 
-    dst_coef_arrays = m->coef;
+        if(marker == JPEG_EOI) {
+            return MJ_ERR_DECODE_JPEG;
+        }
 
-    // save the new coefficients
-    jpeg_write_coefficients(&cinfo, dst_coef_arrays);
+        length = ((size_t)memory[pos + 2] << 8) | memory[pos + 3];
+        if(length < 2) {
+            return MJ_ERR_DECODE_JPEG;
+        }
 
-    // copy the saved markers
-    jpeg_saved_marker_ptr marker;
-    for(marker = m->cinfo.marker_list; marker != NULL; marker = marker->next) {
-        jpeg_write_marker(&cinfo, marker->marker, marker->data, marker->data_length);
+        // SOS, the frame header and the tables are complete
+        if(marker == 0xDA) {
+            break;
+        }
+
+        if(pos + 2 + length > len) {
+            break;
+        }
+
+        data = memory + pos + 4;
+        length -= 2;
+
+        if(marker == JPEG_COM || (marker >= JPEG_APP0 && marker <= JPEG_APP0 + 15)) {
+            p->nmarkers++;
+            p->markers_len += length + 4;
+
+            if(marker == JPEG_APP0 && length >= 5 && memcmp(data, "JFIF\0", 5) == 0) {
+                jfif = 1;
+            }
+            else if(marker == JPEG_APP0 + 14 && length >= 12 && memcmp(data, "Adobe", 5) == 0) {
+                transform = data[11];
+            }
+        }
+        else if(marker == 0xDD) {    // DRI
+            if(length < 2) {
+                return MJ_ERR_DECODE_JPEG;
+            }
+
+            p->restart_interval = (data[0] << 8) | data[1];
+        }
+        else if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 /* DHT */ && marker != 0xC8 /* JPG */ && marker != 0xCC /* DAC */) {
+            if(sof != 0 || length < 6) {
+                return MJ_ERR_DECODE_JPEG;
+            }
+
+            sof = 1;
+
+            p->height = (data[1] << 8) | data[2];
+            p->width = (data[3] << 8) | data[4];
+            p->ncomponents = data[5];
+
+            // SOF2, SOF6, SOF10 and SOF14 are progressive
+            p->progressive = (marker & 0x03) == 0x02 ? 1 : 0;
+
+            if(p->width == 0 || p->height == 0 || p->ncomponents == 0 || p->ncomponents > MAX_COMPONENTS || length < 6 + 3 * (size_t)p->ncomponents) {
+                return MJ_ERR_DECODE_JPEG;
+            }
+
+            for(c = 0; c < p->ncomponents; c++) {
+                ids[c] = data[6 + 3 * c];
+                h = data[7 + 3 * c] >> 4;
+                v = data[7 + 3 * c] & 0x0F;
+
+                if(h < 1 || h > MAX_SAMP_FACTOR || v < 1 || v > MAX_SAMP_FACTOR) {
+                    return MJ_ERR_DECODE_JPEG;
+                }
+
+                if(h > p->sampling.max_h_samp_factor) {
+                    p->sampling.max_h_samp_factor = h;
+                }
+
+                if(v > p->sampling.max_v_samp_factor) {
+                    p->sampling.max_v_samp_factor = v;
+                }
+
+                if(c < 4) {
+                    p->sampling.samp_factor[c].h_samp_factor = h;
+                    p->sampling.samp_factor[c].v_samp_factor = v;
+                }
+            }
+
+            p->sampling.h_factor = (p->sampling.max_h_samp_factor * DCTSIZE);
+            p->sampling.v_factor = (p->sampling.max_v_samp_factor * DCTSIZE);
+        }
+
+        pos += 2 + length + 2;
     }
 
-    jpeg_finish_compress(&cinfo);
-    jpeg_destroy_compress(&cinfo);
+    if(sof == 0) {
+        return MJ_ERR_DECODE_JPEG;
+    }
 
-    *memory = (unsigned char *)dest.buf;
-    *len = dest.size;
+    // guess the colorspace the same way as libjpeg
+    switch(p->ncomponents) {
+        case 1:
+            p->colorspace = JCS_GRAYSCALE;
+            break;
+        case 3:
+            if(jfif == 0 && (transform == 0 || (transform == -1 && ids[0] == 'R' && ids[1] == 'G' && ids[2] == 'B'))) {
+                p->colorspace = JCS_RGB;
+            }
+            else {
+                p->colorspace = JCS_YCbCr;
+            }
+            break;
+        case 4:
+            p->colorspace = transform == 2 ? JCS_YCCK : JCS_CMYK;
+            break;
+        default:
+            p->colorspace = JCS_UNKNOWN;
+            break;
+    }
 
     return MJ_OK;
 }
 
-int mj_write_jpeg_to_file(mj_jpeg_t *m, char *filename, int options) {
-    FILE *         fp;
-    unsigned char *buffer = NULL;
-    size_t         len = 0;
-
+int mj_write_jpeg_to_memory(mj_jpeg_t *m, unsigned char **memory, size_t *len, int options) {
     if(m == NULL) {
         return MJ_ERR_NULL_DATA;
     }
 
-    fp = fopen(filename, "wb");
-    if(fp == NULL) {
-        return MJ_ERR_FILEIO;
-    }
+    int                     rv;
+    struct mj_jpeg_dest_mgr dest;
 
-    mj_write_jpeg_to_memory(m, &buffer, &len, options);
+    dest.buf = NULL;
+    dest.size = 0;
+    dest.pub.init_destination = mj_jpeg_init_destination;
+    dest.pub.empty_output_buffer = mj_jpeg_empty_output_buffer;
+    dest.pub.term_destination = mj_jpeg_term_destination;
 
-    fwrite(buffer, 1, len, fp);
-    fclose(fp);
+    // the output is usually about as long as the input
+    dest.hint = m->len + m->len / 8;
+
+    rv = mj_encode_jpeg(m, &dest.pub, options);
+    if(rv != MJ_OK) {
+        if(dest.buf != NULL) {
+            free(dest.buf);
+        }
+
+        return rv;
+    }
 
-    free(buffer);
+    *memory = (unsigned char *)dest.buf;
+    *len = dest.size;
 
     return MJ_OK;
 }
 
-void mj_init_jpeg(mj_jpeg_t *m) {
+int mj_write_jpeg_to_buffer(mj_jpeg_t *m, unsigned char *buffer, size_t size, mj_chunk_fn fn, void *arg, size_t *len, int options) {
     if(m == NULL) {
-        return;
+        return MJ_ERR_NULL_DATA;
     }
 
-    memset(m, 0, sizeof(mj_jpeg_t));
+    if((buffer == NULL || size == 0) && fn == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
 
-    return;
-}
+    int                       rv;
+    struct mj_jpeg_buffer_mgr dest;
 
-void mj_free_jpeg(mj_jpeg_t *m) {
-    if(m == NULL) {
-        return;
+    dest.buf = (JOCTET *)buffer;
+    dest.size = size;
+    dest.len = 0;
+    dest.fn = fn;
+    dest.arg = arg;
+    dest.full = 0;
+    dest.pub.init_destination = mj_jpeg_init_buffer;
+    dest.pub.empty_output_buffer = mj_jpeg_empty_buffer;
+    dest.pub.term_destination = mj_jpeg_term_buffer;
+
+    if(buffer == NULL) {
+        dest.size = 0;
     }
 
-    jpeg_destroy_decompress(&m->cinfo);
+    rv = mj_encode_jpeg(m, &dest.pub, options);
+    if(rv != MJ_OK) {
+        if(dest.full == 1) {
+            return MJ_ERR_BUFFER_SIZE;
+        }
 
-    mj_init_jpeg(m);
+        return rv;
+    }
 
-    return;
+    if(len != NULL) {
+        *len = dest.len;
+    }
+
+    return MJ_OK;
 }
 
-int mj_encode_raw_to_jpeg_memory(unsigned char **memory, size_t *len, unsigned char *rawdata, int colorspace, J_COLOR_SPACE jpeg_colorspace, mj_sampling_t *s, int width, int height) {
+int mj_encode_jpeg(mj_jpeg_t *m, struct jpeg_destination_mgr *dest, int options) {
     struct jpeg_compress_struct cinfo;
     struct mj_jpeg_error_mgr    jerr;
-    struct mj_jpeg_dest_mgr     dest;
     char                        jpegerrorbuffer[JMSG_LENGTH_MAX];
+    unsigned char *             spliced = NULL;
+    size_t                      spliced_len = 0;
+
+    // copy the restart segments that haven't been modified, otherwise encode the whole image
+    if((options & MJ_OPTION_SPLICE) != 0 && mj_splice_jpeg(m, &spliced, &spliced_len, options) != MJ_OK) {
+        spliced = NULL;
+    }
 
     cinfo.err = jpeg_std_error(&jerr.pub);
     jerr.pub.error_exit = mj_jpeg_error_exit;
     if(setjmp(jerr.setjmp_buffer)) {
         (*cinfo.err->format_message)((j_common_ptr)&cinfo, jpegerrorbuffer);
         jpeg_destroy_compress(&cinfo);
-        if(dest.buf != NULL) {
-            free(dest.buf);
+        if(spliced != NULL) {
+            free(spliced);
         }
 
         return MJ_ERR_ENCODE_JPEG;
     }
 
     jpeg_create_compress(&cinfo);
+    mj_arena_attach(m->arena, (j_common_ptr)&cinfo);
 
-    cinfo.dest = &dest.pub;
-    dest.buf = NULL;
-    dest.size = 0;
-    dest.pub.init_destination = mj_jpeg_init_destination;
-    dest.pub.empty_output_buffer = mj_jpeg_empty_output_buffer;
-    dest.pub.term_destination = mj_jpeg_term_destination;
+    cinfo.dest = dest;
+
+    mj_write_jpeg(m, &cinfo, spliced, spliced_len, options);
+
+    jpeg_destroy_compress(&cinfo);
+
+    if(spliced != NULL) {
+        free(spliced);
+    }
 
-    cinfo.image_width = width;
-    cinfo.image_height = height;
+    return MJ_OK;
+}
 
-    if(colorspace == MJ_COLORSPACE_RGB) {
-        cinfo.input_components = 3;
-        cinfo.in_color_space = JCS_RGB;
+void mj_write_jpeg(mj_jpeg_t *m, struct jpeg_compress_struct *cinfo, const unsigned char *spliced, size_t spliced_len, int options) {
+    // writes the image with the created compress object to its destination
+    if(spliced != NULL) {
+        mj_jpeg_write_bytes(cinfo, spliced, spliced_len);
+        return;
     }
-    else if(colorspace == MJ_COLORSPACE_YCC) {
-        cinfo.input_components = 3;
-        cinfo.in_color_space = JCS_YCbCr;
+
+    jpeg_copy_critical_parameters(&m->cinfo, cinfo);
+
+    mj_set_write_options(cinfo, options);
+
+    // the coefficient arrays are accessed the same way as by the decompress object, they might come from an arena
+    cinfo->mem->access_virt_barray = m->cinfo.mem->access_virt_barray;
+
+    // save the new coefficients
+    jpeg_write_coefficients(cinfo, m->coef);
+
+    // copy the saved markers
+    mj_write_markers(cinfo, m->cinfo.marker_list, -1, mj_get_write_markers(cinfo, &m->cinfo, m->markers));
+
+    jpeg_finish_compress(cinfo);
+
+    return;
+}
+
+void mj_set_write_options(struct jpeg_compress_struct *cinfo, int options) {
+    // only the luminance of a YCbCr JPEG is written. the coefficients of the chroma components are
+    // simply not read by the encoder. like jpegtran, this is only possible if the luminance has the
+    // largest sampling factors, otherwise its blocks don't make up the whole image.
+    if((options & MJ_OPTION_GRAYSCALE) != 0 && cinfo->jpeg_color_space == JCS_YCbCr && cinfo->num_components == 3 && mj_is_full_luminance(cinfo) == 1) {
+        int quant_tbl_no = cinfo->comp_info[0].quant_tbl_no;
+
+        jpeg_set_colorspace(cinfo, JCS_GRAYSCALE);
+        cinfo->comp_info[0].quant_tbl_no = quant_tbl_no;
     }
-    else if(colorspace == MJ_COLORSPACE_GRAYSCALE) {
-        cinfo.input_components = 1;
-        cinfo.in_color_space = JCS_GRAYSCALE;
+
+    if((options & MJ_OPTION_OPTIMIZE) != 0) {
+        cinfo->optimize_coding = TRUE;
     }
     else {
-        jpeg_destroy_compress(&cinfo);
-        return MJ_ERR_UNSUPPORTED_COLORSPACE;
+        cinfo->optimize_coding = FALSE;
     }
 
-    jpeg_set_defaults(&cinfo);
+    if((options & MJ_OPTION_PROGRESSIVE) != 0) {
+        jpeg_simple_progression(cinfo);
+    }
+    else {
+        cinfo->scan_info = NULL;
+    }
+
+    if((options & MJ_OPTION_ARITHMETRIC) != 0) {
+        cinfo->arith_code = TRUE;
+    }
+    else {
+        cinfo->arith_code = FALSE;
+    }
+
+    return;
+}
 
-    jpeg_set_colorspace(&cinfo, jpeg_colorspace);
+static int mj_is_full_luminance(struct jpeg_compress_struct *cinfo) {
+    // the compress object doesn't know the maximum sampling factors yet
+    int c;
 
-    cinfo.optimize_coding = FALSE;    // don't optimize
-    cinfo.scan_info = NULL;           // don't create progressive output
-    cinfo.arith_code = FALSE;         // don't do arithmetric coding
+    for(c = 1; c < cinfo->num_components; c++) {
+        if(cinfo->comp_info[c].h_samp_factor > cinfo->comp_info[0].h_samp_factor || cinfo->comp_info[c].v_samp_factor > cinfo->comp_info[0].v_samp_factor) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
 
-    if(colorspace == MJ_COLORSPACE_RGB || colorspace == MJ_COLORSPACE_YCC) {
-        cinfo.comp_info[0].h_samp_factor = s->samp_factor[0].h_samp_factor;
-        cinfo.comp_info[0].v_samp_factor = s->samp_factor[0].v_samp_factor;
+int mj_get_write_markers(struct jpeg_compress_struct *cinfo, struct jpeg_decompress_struct *dinfo, int markers) {
+    // the markers to write for the compress object that has been set up from the decompress object
+    if(cinfo->num_components < dinfo->num_components) {
+        markers |= MJ_MARKER_NO_ICC;
+    }
 
-        cinfo.comp_info[1].h_samp_factor = s->samp_factor[1].h_samp_factor;
-        cinfo.comp_info[1].v_samp_factor = s->samp_factor[1].v_samp_factor;
+    return markers;
+}
 
-        cinfo.comp_info[2].h_samp_factor = s->samp_factor[2].h_samp_factor;
-        cinfo.comp_info[2].v_samp_factor = s->samp_factor[2].v_samp_factor;
+int mj_write_jpeg_to_fd(mj_jpeg_t *m, int fd, int options) {
+    if(m == NULL) {
+        return MJ_ERR_NULL_DATA;
     }
-    else {
-        cinfo.comp_info[0].h_samp_factor = s->samp_factor[0].h_samp_factor;
-        cinfo.comp_info[0].v_samp_factor = s->samp_factor[0].v_samp_factor;
+
+    if(fd < 0) {
+        return MJ_ERR_FILEIO;
     }
 
-    jpeg_set_quality(&cinfo, 100, TRUE);
+    int                   rv;
+    struct mj_jpeg_fd_mgr dest;
 
-    jpeg_start_compress(&cinfo, TRUE);
+    dest.fd = fd;
+    dest.buf = NULL;
+    dest.failed = 0;
+    dest.pub.init_destination = mj_jpeg_init_fd;
+    dest.pub.empty_output_buffer = mj_jpeg_empty_fd;
+    dest.pub.term_destination = mj_jpeg_term_fd;
+
+    // the JPEG is written in chunks while it's encoded
+    rv = mj_encode_jpeg(m, &dest.pub, options);
+    if(rv != MJ_OK && dest.failed == 1) {
+        return MJ_ERR_FILEIO;
+    }
 
-    int row_stride = cinfo.image_width * cinfo.input_components;
+    return rv;
+}
 
-    JSAMPROW row_pointer[1];
+int mj_write_jpeg_to_file(mj_jpeg_t *m, char *filename, int options) {
+    int fd, rv;
 
-    while(cinfo.next_scanline < cinfo.image_height) {
-        row_pointer[0] = &rawdata[cinfo.next_scanline * row_stride];
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+    if(m == NULL || filename == NULL) {
+        return MJ_ERR_NULL_DATA;
     }
 
-    jpeg_finish_compress(&cinfo);
-    jpeg_destroy_compress(&cinfo);
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0) {
+        return MJ_ERR_FILEIO;
+    }
 
-    *memory = (unsigned char *)dest.buf;
-    *len = dest.size;
+    rv = mj_write_jpeg_to_fd(m, fd, options);
 
-    return MJ_OK;
+    if(close(fd) != 0 && rv == MJ_OK) {
+        rv = MJ_ERR_FILEIO;
+    }
+
+    // don't leave a partial JPEG behind
+    if(rv != MJ_OK) {
+        remove(filename);
+    }
+
+    return rv;
+}
+
+void mj_init_jpeg(mj_jpeg_t *m) {
+    if(m == NULL) {
+        return;
+    }
+
+    memset(m, 0, sizeof(mj_jpeg_t));
+
+    m->markers = MJ_MARKERS_ALL;
+
+    return;
+}
+
+void mj_free_jpeg(mj_jpeg_t *m) {
+    if(m == NULL) {
+        return;
+    }
+
+    // the marker policy, the splice flag and the arena are kept for the next image
+    int         markers = m->markers;
+    int         splice = m->splice;
+    mj_arena_t *arena = m->arena;
+
+    jpeg_destroy_decompress(&m->cinfo);
+    mj_splice_free(m);
+
+    mj_init_jpeg(m);
+
+    m->markers = markers;
+    m->splice = splice;
+    m->arena = arena;
+
+    return;
 }
 
 int mj_decode_jpeg_file_to_raw(unsigned char **rawdata, int *width, int *height, int want_colorspace, const char *filename) {
@@ -368,7 +747,7 @@ int mj_decode_jpeg_file_to_raw(unsigned char **rawdata, int *width, int *height,
     jpeg_stdio_src(&cinfo, fp);
 
     int rv;
-    rv = mj_decode_jpeg_to_raw(rawdata, width, height, want_colorspace, &cinfo);
+    rv = mj_decode_jpeg_to_raw(rawdata, width, height, want_colorspace, &cinfo, NULL);
 
     jpeg_finish_decompress(&cinfo);
     jpeg_destroy_decompress(&cinfo);
@@ -376,7 +755,7 @@ int mj_decode_jpeg_file_to_raw(unsigned char **rawdata, int *width, int *height,
     return rv;
 }
 
-int mj_decode_jpeg_memory_to_raw(unsigned char **rawdata, int *width, int *height, int want_colorspace, const unsigned char *memory, size_t blen) {
+int mj_decode_jpeg_memory_to_raw(unsigned char **rawdata, int *width, int *height, int want_colorspace, const unsigned char *memory, size_t blen, mj_arena_t *arena) {
     struct jpeg_decompress_struct cinfo;
     struct mj_jpeg_error_mgr      jerr;
     struct mj_jpeg_src_mgr        src;
@@ -389,6 +768,7 @@ int mj_decode_jpeg_memory_to_raw(unsigned char **rawdata, int *width, int *heigh
     }
 
     jpeg_create_decompress(&cinfo);
+    mj_arena_attach(arena, (j_common_ptr)&cinfo);
 
     cinfo.src = &src.pub;
     src.pub.init_source = mj_jpeg_init_source;
@@ -401,7 +781,7 @@ int mj_decode_jpeg_memory_to_raw(unsigned char **rawdata, int *width, int *heigh
     src.size = blen;
 
     int rv;
-    rv = mj_decode_jpeg_to_raw(rawdata, width, height, want_colorspace, &cinfo);
+    rv = mj_decode_jpeg_to_raw(rawdata, width, height, want_colorspace, &cinfo, arena);
 
     jpeg_finish_decompress(&cinfo);
     jpeg_destroy_decompress(&cinfo);
@@ -409,7 +789,7 @@ int mj_decode_jpeg_memory_to_raw(unsigned char **rawdata, int *width, int *heigh
     return rv;
 }
 
-int mj_decode_jpeg_to_raw(unsigned char **rawdata, int *width, int *height, int want_colorspace, struct jpeg_decompress_struct *cinfo) {
+int mj_decode_jpeg_to_raw(unsigned char **rawdata, int *width, int *height, int want_colorspace, struct jpeg_decompress_struct *cinfo, mj_arena_t *arena) {
     jpeg_read_header(cinfo, TRUE);
 
     switch(want_colorspace) {
@@ -433,7 +813,7 @@ int mj_decode_jpeg_to_raw(unsigned char **rawdata, int *width, int *height, int
 
     int row_stride = cinfo->output_width * cinfo->output_components;
 
-    unsigned char *buf = (unsigned char *)calloc(row_stride * cinfo->output_height, sizeof(unsigned char));
+    unsigned char *buf = (unsigned char *)mj_alloc(arena, (size_t)row_stride * cinfo->output_height);
     if(buf == NULL) {
         return MJ_ERR_MEMORY;
     }
@@ -488,3 +868,75 @@ int mj_read_file(unsigned char **buffer, size_t *len, const char *filename) {
 
     return MJ_OK;
 }
+
+int mj_map_file(mj_file_t *f, const char *filename) {
+    if(f == NULL || filename == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    int         fd;
+    struct stat s;
+    void *      data;
+
+    memset(f, 0, sizeof(mj_file_t));
+
+    fd = open(filename, O_RDONLY);
+    if(fd < 0) {
+        return MJ_ERR_FILEIO;
+    }
+
+    if(fstat(fd, &s) != 0) {
+        close(fd);
+        return MJ_ERR_FILEIO;
+    }
+
+    // pipes, devices, and empty files can't be mapped
+    if(S_ISREG(s.st_mode) == 0 || s.st_size == 0) {
+        close(fd);
+
+        return mj_read_file(&f->data, &f->len, filename);
+    }
+
+    // the file is read once from start to end, the pages can be loaded right away
+#ifdef MAP_POPULATE
+    data = mmap(NULL, (size_t)s.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+#else
+    data = mmap(NULL, (size_t)s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+#endif
+
+    close(fd);
+
+    if(data == MAP_FAILED) {
+        return mj_read_file(&f->data, &f->len, filename);
+    }
+
+#ifdef MADV_SEQUENTIAL
+    madvise(data, (size_t)s.st_size, MADV_SEQUENTIAL);
+#endif
+#if !defined(MAP_POPULATE) && defined(MADV_WILLNEED)
+    madvise(data, (size_t)s.st_size, MADV_WILLNEED);
+#endif
+
+    f->data = (unsigned char *)data;
+    f->len = (size_t)s.st_size;
+    f->mapped = 1;
+
+    return MJ_OK;
+}
+
+void mj_unmap_file(mj_file_t *f) {
+    if(f == NULL || f->data == NULL) {
+        return;
+    }
+
+    if(f->mapped == 1) {
+        munmap(f->data, f->len);
+    }
+    else {
+        free(f->data);
+    }
+
+    memset(f, 0, sizeof(mj_file_t));
+
+    return;
+}
@@ -25,12 +25,28 @@
 
 #include "libmodjpeg.h"
 
-int mj_encode_raw_to_jpeg_memory(unsigned char **memory, size_t *len, unsigned char *rawdata, int colorspace, J_COLOR_SPACE jpeg_colorspace, mj_sampling_t *s, int width, int height);
+int  mj_read_jpeg(mj_jpeg_t *m, const unsigned char *memory, size_t len, size_t max_pixel);
+void mj_setup_jpeg(mj_jpeg_t *m);
+int  mj_derive_jpeg(mj_jpeg_t *dst, mj_jpeg_t *src, JDIMENSION width, JDIMENSION height);
+void mj_get_block_rows(mj_jpeg_t *m, int component, JDIMENSION *start, JDIMENSION *end);
+int  mj_encode_jpeg(mj_jpeg_t *m, struct jpeg_destination_mgr *dest, int options);
+void mj_write_jpeg(mj_jpeg_t *m, struct jpeg_compress_struct *cinfo, const unsigned char *spliced, size_t spliced_len, int options);
+void mj_set_write_options(struct jpeg_compress_struct *cinfo, int options);
+int  mj_get_write_markers(struct jpeg_compress_struct *cinfo, struct jpeg_decompress_struct *dinfo, int markers);
 
 int mj_decode_jpeg_file_to_raw(unsigned char **rawdata, int *width, int *height, int want_colorspace, const char *filename);
-int mj_decode_jpeg_memory_to_raw(unsigned char **rawdata, int *width, int *height, int want_colorspace, const unsigned char *memory, size_t blen);
-int mj_decode_jpeg_to_raw(unsigned char **data, int *width, int *height, int want_colorspace, struct jpeg_decompress_struct *cinfo);
+int mj_decode_jpeg_memory_to_raw(unsigned char **rawdata, int *width, int *height, int want_colorspace, const unsigned char *memory, size_t blen, mj_arena_t *arena);
+int mj_decode_jpeg_to_raw(unsigned char **data, int *width, int *height, int want_colorspace, struct jpeg_decompress_struct *cinfo, mj_arena_t *arena);
 
-int mj_read_file(unsigned char **buffer, size_t *len, const char *filename);
+// a file in memory, either mapped or read into an allocated buffer
+typedef struct {
+    unsigned char *data;
+    size_t         len;
+    int            mapped;
+} mj_file_t;
+
+int  mj_read_file(unsigned char **buffer, size_t *len, const char *filename);
+int  mj_map_file(mj_file_t *f, const char *filename);
+void mj_unmap_file(mj_file_t *f);
 
 #endif
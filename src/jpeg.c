@@ -24,10 +24,13 @@
 
 #include "libmodjpeg.h"
 
+#include <errno.h>
 #include <jerror.h>
 #include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 /** JPEG reading and writing **/
 
@@ -41,15 +44,21 @@ void mj_jpeg_error_exit(j_common_ptr cinfo) {
 
 void mj_jpeg_init_destination(j_compress_ptr cinfo) {
     mj_jpeg_dest_ptr dest = (mj_jpeg_dest_ptr)cinfo->dest;
+    size_t           size = MJ_DESTBUFFER_CHUNKSIZE;
 
-    dest->buf = (JOCTET *)malloc(MJ_DESTBUFFER_CHUNKSIZE * sizeof(JOCTET));
+    // start with the expected length in order to avoid growing the buffer
+    if(dest->hint > size) {
+        size = dest->hint;
+    }
+
+    dest->buf = (JOCTET *)malloc(size * sizeof(JOCTET));
     if(dest->buf == NULL) {
         ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
     }
-    dest->size = MJ_DESTBUFFER_CHUNKSIZE;
+    dest->size = size;
 
     dest->pub.next_output_byte = dest->buf;
-    dest->pub.free_in_buffer = MJ_DESTBUFFER_CHUNKSIZE;
+    dest->pub.free_in_buffer = size;
 
     return;
 }
@@ -58,15 +67,17 @@ boolean mj_jpeg_empty_output_buffer(j_compress_ptr cinfo) {
     JOCTET *         ret;
     mj_jpeg_dest_ptr dest = (mj_jpeg_dest_ptr)cinfo->dest;
 
-    ret = (JOCTET *)realloc(dest->buf, (dest->size + MJ_DESTBUFFER_CHUNKSIZE) * sizeof(JOCTET));
+    // doubling the size keeps the number of copies linear in the length of the JPEG
+    ret = (JOCTET *)realloc(dest->buf, 2 * dest->size * sizeof(JOCTET));
     if(ret == NULL) {
         ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
     }
     dest->buf = ret;
-    dest->size += MJ_DESTBUFFER_CHUNKSIZE;
 
-    dest->pub.next_output_byte = dest->buf + (dest->size - MJ_DESTBUFFER_CHUNKSIZE);
-    dest->pub.free_in_buffer = MJ_DESTBUFFER_CHUNKSIZE;
+    dest->pub.next_output_byte = dest->buf + dest->size;
+    dest->pub.free_in_buffer = dest->size;
+
+    dest->size *= 2;
 
     return TRUE;
 }
@@ -79,6 +90,162 @@ void mj_jpeg_term_destination(j_compress_ptr cinfo) {
     return;
 }
 
+void mj_jpeg_init_buffer(j_compress_ptr cinfo) {
+    mj_jpeg_buffer_ptr dest = (mj_jpeg_buffer_ptr)cinfo->dest;
+
+    dest->len = 0;
+
+    // without a buffer, the first chunk comes from the chunk function
+    if(dest->buf == NULL) {
+        dest->size = 0;
+        dest->buf = (JOCTET *)dest->fn(dest->arg, NULL, 0, &dest->size);
+        if(dest->buf == NULL || dest->size == 0) {
+            dest->full = 1;
+            ERREXIT(cinfo, JERR_BUFFER_SIZE);
+        }
+    }
+
+    dest->pub.next_output_byte = dest->buf;
+    dest->pub.free_in_buffer = dest->size;
+
+    return;
+}
+
+boolean mj_jpeg_empty_buffer(j_compress_ptr cinfo) {
+    mj_jpeg_buffer_ptr dest = (mj_jpeg_buffer_ptr)cinfo->dest;
+
+    if(dest->fn == NULL) {
+        if(dest->buf == &dest->spare) {
+            dest->full = 1;
+            ERREXIT(cinfo, JERR_BUFFER_SIZE);
+        }
+
+        dest->len += dest->size;
+        dest->buf = &dest->spare;
+        dest->size = 1;
+
+        dest->pub.next_output_byte = dest->buf;
+        dest->pub.free_in_buffer = dest->size;
+
+        return TRUE;
+    }
+
+    // hand over the full chunk and continue with the next one
+    dest->len += dest->size;
+    dest->buf = (JOCTET *)dest->fn(dest->arg, dest->buf, dest->size, &dest->size);
+    if(dest->buf == NULL || dest->size == 0) {
+        dest->full = 1;
+        ERREXIT(cinfo, JERR_BUFFER_SIZE);
+    }
+
+    dest->pub.next_output_byte = dest->buf;
+    dest->pub.free_in_buffer = dest->size;
+
+    return TRUE;
+}
+
+void mj_jpeg_term_buffer(j_compress_ptr cinfo) {
+    mj_jpeg_buffer_ptr dest = (mj_jpeg_buffer_ptr)cinfo->dest;
+
+    if(dest->buf == &dest->spare) {
+        if(dest->pub.free_in_buffer == 0) {
+            dest->full = 1;
+            ERREXIT(cinfo, JERR_BUFFER_SIZE);
+        }
+
+        return;
+    }
+
+    dest->len += dest->size - dest->pub.free_in_buffer;
+
+    if(dest->fn != NULL) {
+        dest->fn(dest->arg, dest->buf, dest->size - dest->pub.free_in_buffer, NULL);
+    }
+
+    return;
+}
+
+void mj_jpeg_init_fd(j_compress_ptr cinfo) {
+    mj_jpeg_fd_ptr dest = (mj_jpeg_fd_ptr)cinfo->dest;
+
+    dest->buf = (JOCTET *)(*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_IMAGE, MJ_FDBUFFER_SIZE * sizeof(JOCTET));
+
+    dest->pub.next_output_byte = dest->buf;
+    dest->pub.free_in_buffer = MJ_FDBUFFER_SIZE;
+
+    return;
+}
+
+boolean mj_jpeg_empty_fd(j_compress_ptr cinfo) {
+    mj_jpeg_fd_ptr dest = (mj_jpeg_fd_ptr)cinfo->dest;
+
+    mj_jpeg_write_fd(cinfo, MJ_FDBUFFER_SIZE);
+
+    dest->pub.next_output_byte = dest->buf;
+    dest->pub.free_in_buffer = MJ_FDBUFFER_SIZE;
+
+    return TRUE;
+}
+
+void mj_jpeg_term_fd(j_compress_ptr cinfo) {
+    mj_jpeg_fd_ptr dest = (mj_jpeg_fd_ptr)cinfo->dest;
+
+    mj_jpeg_write_fd(cinfo, MJ_FDBUFFER_SIZE - dest->pub.free_in_buffer);
+
+    return;
+}
+
+void mj_jpeg_write_fd(j_compress_ptr cinfo, size_t len) {
+    mj_jpeg_fd_ptr dest = (mj_jpeg_fd_ptr)cinfo->dest;
+    const JOCTET * p = dest->buf;
+    ssize_t        n;
+
+    // write() may write less than asked for or be interrupted by a signal
+    while(len > 0) {
+        n = write(dest->fd, p, len);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            dest->failed = 1;
+            ERREXIT(cinfo, JERR_FILE_WRITE);
+        }
+
+        p += n;
+        len -= (size_t)n;
+    }
+
+    return;
+}
+
+void mj_jpeg_write_bytes(j_compress_ptr cinfo, const JOCTET *data, size_t len) {
+    // writes an already encoded JPEG to any destination
+    struct jpeg_destination_mgr *dest = cinfo->dest;
+    size_t                       n;
+
+    (*dest->init_destination)(cinfo);
+
+    while(len > 0) {
+        if(dest->free_in_buffer == 0 && (*dest->empty_output_buffer)(cinfo) == FALSE) {
+            ERREXIT(cinfo, JERR_CANT_SUSPEND);
+        }
+
+        n = len < dest->free_in_buffer ? len : dest->free_in_buffer;
+
+        memcpy(dest->next_output_byte, data, n);
+        dest->next_output_byte += n;
+        dest->free_in_buffer -= n;
+
+        data += n;
+        len -= n;
+    }
+
+    (*dest->term_destination)(cinfo);
+
+    return;
+}
+
 void mj_jpeg_init_source(j_decompress_ptr cinfo) {
     mj_jpeg_src_ptr src = (mj_jpeg_src_ptr)cinfo->src;
 
@@ -27,7 +27,8 @@
 
 #include <setjmp.h>
 
-#define MJ_DESTBUFFER_CHUNKSIZE 2048
+#define MJ_DESTBUFFER_CHUNKSIZE 2048    // the minimum size of the output buffer, it grows by doubling
+#define MJ_FDBUFFER_SIZE        65536    // the size of the chunks that are written to a file descriptor
 
 struct mj_jpeg_error_mgr {
     struct jpeg_error_mgr pub;
@@ -39,7 +40,28 @@ struct mj_jpeg_dest_mgr {
     struct jpeg_destination_mgr pub;
 
     JOCTET *buf;
-    size_t  size;
+    size_t  size;    // the size of the buffer while writing, the length of the JPEG afterwards
+    size_t  hint;    // the expected length of the JPEG, 0 if unknown
+};
+
+struct mj_jpeg_buffer_mgr {
+    struct jpeg_destination_mgr pub;
+
+    JOCTET *    buf;     // the current chunk
+    size_t      size;    // the size of the current chunk
+    size_t      len;     // the number of bytes in all chunks
+    mj_chunk_fn fn;
+    void *      arg;
+    int         full;    // the JPEG doesn't fit into the provided chunks
+    JOCTET      spare;   // libjpeg asks for more space as soon as a chunk is full, even if it's done
+};
+
+struct mj_jpeg_fd_mgr {
+    struct jpeg_destination_mgr pub;
+
+    int     fd;
+    JOCTET *buf;
+    int     failed;    // writing to the file descriptor failed
 };
 
 struct mj_jpeg_src_mgr {
@@ -52,6 +74,8 @@ struct mj_jpeg_src_mgr {
 typedef struct mj_jpeg_error_mgr *mj_jpeg_error_ptr;
 typedef struct mj_jpeg_src_mgr *  mj_jpeg_src_ptr;
 typedef struct mj_jpeg_dest_mgr * mj_jpeg_dest_ptr;
+typedef struct mj_jpeg_buffer_mgr *mj_jpeg_buffer_ptr;
+typedef struct mj_jpeg_fd_mgr *    mj_jpeg_fd_ptr;
 
 void    mj_jpeg_init_source(j_decompress_ptr cinfo);
 boolean mj_jpeg_fill_input_buffer(j_decompress_ptr cinfo);
@@ -62,5 +86,13 @@ void    mj_jpeg_error_exit(j_common_ptr cinfo);
 void    mj_jpeg_init_destination(j_compress_ptr cinfo);
 boolean mj_jpeg_empty_output_buffer(j_compress_ptr cinfo);
 void    mj_jpeg_term_destination(j_compress_ptr cinfo);
+void    mj_jpeg_init_buffer(j_compress_ptr cinfo);
+boolean mj_jpeg_empty_buffer(j_compress_ptr cinfo);
+void    mj_jpeg_term_buffer(j_compress_ptr cinfo);
+void    mj_jpeg_init_fd(j_compress_ptr cinfo);
+boolean mj_jpeg_empty_fd(j_compress_ptr cinfo);
+void    mj_jpeg_term_fd(j_compress_ptr cinfo);
+void    mj_jpeg_write_fd(j_compress_ptr cinfo, size_t len);
+void    mj_jpeg_write_bytes(j_compress_ptr cinfo, const JOCTET *data, size_t len);
 
 #endif
@@ -30,10 +30,10 @@
 #include <jpeglib.h>
 // clang-format on
 
-#define MJ_LIB_VERSION_MAJOR   1
+#define MJ_LIB_VERSION_MAJOR   2
 #define MJ_LIB_VERSION_MINOR   0
 #define MJ_LIB_VERSION_RELEASE 0
-#define MJ_LIB_VERSION         10000
+#define MJ_LIB_VERSION         20000
 
 #define MJ_COLORSPACE_RGB        1
 #define MJ_COLORSPACE_RGBA       2
@@ -56,6 +56,33 @@
 #define MJ_OPTION_OPTIMIZE    (1 << 0)
 #define MJ_OPTION_PROGRESSIVE (1 << 1)
 #define MJ_OPTION_ARITHMETRIC (1 << 2)
+#define MJ_OPTION_FIXEDPOINT  (1 << 3)
+#define MJ_OPTION_SPLICE      (1 << 4)
+#define MJ_OPTION_GRAYSCALE   (1 << 5)
+
+// the markers that are kept on reading and writing an image. MJ_MARKER_ICC keeps APP2 markers with
+// an ICC profile, MJ_MARKER_ORIENTATION replaces APP1 markers with EXIF data by one that only holds
+// the orientation.
+#define MJ_MARKER_APP(n)      (1 << (n))
+#define MJ_MARKER_COM         (1 << 16)
+#define MJ_MARKER_ICC         (1 << 17)
+#define MJ_MARKER_ORIENTATION (1 << 18)
+
+#define MJ_MARKERS_NONE 0
+#define MJ_MARKERS_ICC  (MJ_MARKER_ICC | MJ_MARKER_ORIENTATION)
+#define MJ_MARKERS_ALL  (0xFFFF | MJ_MARKER_COM)
+
+// the operations of a batch job
+#define MJ_BATCH_COMPOSE          1    // mj_compose() with dropon, align, offset_x, offset_y
+#define MJ_BATCH_COMPOSE_COMPILED 2    // mj_compose_compiled() with compileddropon, align, offset_x, offset_y
+#define MJ_BATCH_GRAYSCALE        3    // mj_effect_grayscale()
+#define MJ_BATCH_PIXELATE         4    // mj_effect_pixelate()
+#define MJ_BATCH_TINT             5    // mj_effect_tint() with value[0] and value[1]
+#define MJ_BATCH_LUMINANCE        6    // mj_effect_luminance() with value[0]
+#define MJ_BATCH_FN               7    // fn(m, arg)
+#define MJ_BATCH_PIPELINE         8    // mj_effect_pipeline() with pipeline
+#define MJ_BATCH_CONTRAST         9    // mj_effect_contrast() with value[0]
+#define MJ_BATCH_SATURATION       10   // mj_effect_saturation() with value[0]
 
 #define MJ_OK                         0
 #define MJ_ERR_MEMORY                 1
@@ -67,6 +94,12 @@
 #define MJ_ERR_FILEIO                 7
 #define MJ_ERR_IMAGE_SIZE             8
 #define MJ_ERR_UNSUPPORTED_FILETYPE   9
+#define MJ_ERR_INCOMPATIBLE_DROPON    10
+#define MJ_ERR_UNSUPPORTED_SAMPLING   11
+#define MJ_ERR_UNSUPPORTED_STREAMING  12
+#define MJ_ERR_BUFFER_SIZE            13
+#define MJ_ERR_UNKNOWN_OPERATION      14
+#define MJ_ERR_UNSUPPORTED_SCALE      15
 
 typedef struct {
     int h_samp_factor;
@@ -92,20 +125,69 @@ typedef struct {
     int h_samp_factor;
     int v_samp_factor;
 
-    int          nblocks;
-    mj_block_t **blocks;
+    int            nblocks;
+    mj_block_t *   blocks;         // nblocks * DCTSIZE2 coefficients, row by row
+    short *        fixedblocks;    // the blocks in fixed point for MJ_OPTION_FIXEDPOINT, NULL otherwise
+    unsigned char *blocktypes;     // nblocks types of the blocks of a mask, NULL otherwise
 } mj_component_t;
 
+// the quantization table of a component with reciprocals of its values, such that
+// x / quantval[i] == (x * multiplier[i]) >> shift[i] for 0 <= x < 2^31
+typedef struct {
+    UINT16       quantval[DCTSIZE2];
+    unsigned int multiplier[DCTSIZE2];
+    unsigned int shift[DCTSIZE2];
+} mj_quanttable_t;
+
+// the original JPEG for MJ_OPTION_SPLICE. only kept for baseline JPEGs with restart markers and a single scan.
+typedef struct {
+    unsigned char *data;    // NULL if the JPEG can't be spliced
+    size_t         len;
+    size_t         scan;    // the offset of the entropy-coded data
+
+    int ncomponents;
+    int components[MAX_COMPS_IN_SCAN];    // the components in the order of the scan
+
+    int mcus_per_row;
+    int nmcus;
+    int restart_interval;
+
+    int            nsegments;
+    unsigned char *modified;    // a flag for each restart segment whether its blocks have been changed
+} mj_original_t;
+
+typedef struct mj_arena mj_arena_t;
+
 typedef struct {
     struct jpeg_decompress_struct cinfo;
     jvirt_barray_ptr *            coef;
 
-    int width;
-    int height;
+    int    width;
+    int    height;
+    size_t len;        // the length of the JPEG that has been read
+    int    markers;    // the markers to keep, MJ_MARKERS_ALL by default
+    int    splice;     // keep the original JPEG for MJ_OPTION_SPLICE if not 0, 0 by default
 
-    mj_sampling_t sampling;
+    mj_arena_t *arena;    // the memory for libjpeg and the image comes from here if not NULL
+
+    mj_sampling_t   sampling;
+    mj_quanttable_t quant[4];
+
+    // the iMCU rows [band_start, band_end) that are in memory while the image is streamed, 0 otherwise
+    int band_start;
+    int band_end;
+
+    mj_original_t original;
 } mj_jpeg_t;
 
+// a rectangle in pixels
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+} mj_rect_t;
+
 typedef struct {
     unsigned char *image;
     unsigned char *alpha;
@@ -115,17 +197,91 @@ typedef struct {
     int colorspace;
 
     int blend;
+
+    mj_arena_t *arena;    // the memory for the dropon comes from here if not NULL
 } mj_dropon_t;
 
 typedef struct {
+    int width;
+    int height;
+    int blend;
+    int options;
+
+    mj_sampling_t sampling;
+
+    int blockoffset_x;
+    int blockoffset_y;
+
     int             image_ncomponents;
     int             image_colorspace;
     mj_component_t *image;
 
     int             alpha_ncomponents;
     mj_component_t *alpha;
+    mj_component_t *mask;
+
+    mj_arena_t *arena;    // the arena of the dropon it has been compiled from
 } mj_compileddropon_t;
 
+// the header of a JPEG as found by mj_probe_jpeg()
+typedef struct {
+    int width;
+    int height;
+    int colorspace;
+    int ncomponents;
+
+    mj_sampling_t sampling;
+
+    int progressive;
+    int restart_interval;
+
+    int    nmarkers;       // the number of APPn and COM markers
+    size_t markers_len;    // their total length in bytes
+} mj_probe_t;
+
+typedef struct mj_pool     mj_pool_t;
+typedef struct mj_reader   mj_reader_t;
+typedef struct mj_context  mj_context_t;
+typedef struct mj_pipeline mj_pipeline_t;
+
+typedef int (*mj_band_fn)(mj_jpeg_t *m, void *arg);
+
+// hands over a chunk with len bytes of the JPEG and returns the next chunk to write into with its size in *size. chunk
+// is NULL on the first call. after the last chunk, size is NULL and the return value is ignored.
+typedef unsigned char *(*mj_chunk_fn)(void *arg, unsigned char *chunk, size_t len, size_t *size);
+
+typedef struct {
+    int type;
+
+    mj_dropon_t *        dropon;
+    mj_compileddropon_t *compileddropon;
+    unsigned int         align;
+    int                  offset_x;
+    int                  offset_y;
+
+    int            value[2];
+    mj_pipeline_t *pipeline;
+
+    mj_band_fn fn;
+    void *     arg;
+} mj_batch_op_t;
+
+typedef struct {
+    const unsigned char *input;
+    size_t               input_len;
+    size_t               max_pixel;
+
+    const mj_batch_op_t *ops;
+    int                  nops;
+
+    int options;    // the options for writing the JPEG
+
+    // the result of the job. output is allocated and must be free'd after use, NULL if the job failed.
+    unsigned char *output;
+    size_t         output_len;
+    int            rv;
+} mj_batch_job_t;
+
 void mj_init_dropon(mj_dropon_t *d);
 int  mj_read_dropon_from_raw(mj_dropon_t *d, const unsigned char *rawdata, unsigned int colorspace, int width, int height, short blend);
 int  mj_read_dropon_from_memory(mj_dropon_t *d, const unsigned char *memory, size_t len, const unsigned char *maskmemory, size_t masklen, short blend);
@@ -134,11 +290,45 @@ int  mj_read_dropon_from_file(mj_dropon_t *d, const char *filename, const char *
 void mj_init_jpeg(mj_jpeg_t *m);
 int  mj_read_jpeg_from_memory(mj_jpeg_t *m, const unsigned char *memory, size_t len, size_t max_pixel);
 int  mj_read_jpeg_from_file(mj_jpeg_t *m, const char *filename, size_t max_pixel);
+int  mj_probe_jpeg(mj_probe_t *p, const unsigned char *memory, size_t len);
+
+mj_reader_t *mj_create_reader(mj_jpeg_t *m, size_t max_pixel);
+int          mj_reader_feed(mj_reader_t *r, const unsigned char *bytes, size_t len);
+int          mj_reader_finish(mj_reader_t *r);
+void         mj_free_reader(mj_reader_t *r);
+
+mj_context_t *mj_create_context(void);
+int           mj_read_jpeg_from_memory_context(mj_jpeg_t *m, const unsigned char *memory, size_t len, size_t max_pixel, mj_context_t *ctx);
+int           mj_write_jpeg_to_memory_context(mj_jpeg_t *m, const unsigned char **memory, size_t *len, int options, mj_context_t *ctx);
+void          mj_free_context(mj_context_t *ctx);
+
+void mj_init_compileddropon(mj_compileddropon_t *cd);
+int  mj_compile_dropon(mj_compileddropon_t *cd, mj_dropon_t *d, J_COLOR_SPACE colorspace, mj_sampling_t *sampling, int blockoffset_x, int blockoffset_y);
+int  mj_compile_dropon_options(mj_compileddropon_t *cd, mj_dropon_t *d, J_COLOR_SPACE colorspace, mj_sampling_t *sampling, int blockoffset_x, int blockoffset_y, int options);
+void mj_free_compileddropon(mj_compileddropon_t *cd);
+
+mj_pool_t *mj_create_pool(int nworkers);
+void       mj_free_pool(mj_pool_t *pool);
+
+mj_arena_t *mj_create_arena(size_t chunksize);
+void        mj_reset_arena(mj_arena_t *arena);
+void        mj_free_arena(mj_arena_t *arena);
 
 int mj_compose(mj_jpeg_t *m, mj_dropon_t *d, unsigned int align, int offset_x, int offset_y);
+int mj_compose_compiled(mj_jpeg_t *m, mj_compileddropon_t *cd, unsigned int align, int offset_x, int offset_y);
+int mj_compose_compiled_parallel(mj_jpeg_t *m, mj_compileddropon_t *cd, unsigned int align, int offset_x, int offset_y, mj_pool_t *pool);
 
 int mj_write_jpeg_to_memory(mj_jpeg_t *m, unsigned char **memory, size_t *len, int options);
+int mj_write_jpeg_to_buffer(mj_jpeg_t *m, unsigned char *buffer, size_t size, mj_chunk_fn fn, void *arg, size_t *len, int options);
 int mj_write_jpeg_to_file(mj_jpeg_t *m, char *filename, int options);
+int mj_write_jpeg_to_fd(mj_jpeg_t *m, int fd, int options);
+
+int mj_downscale(mj_jpeg_t *dst, mj_jpeg_t *src, int denom);
+int mj_crop(mj_jpeg_t *m, int x, int y, int width, int height);
+
+int mj_batch_run(mj_batch_job_t *jobs, int njobs, mj_pool_t *pool);
+
+int mj_stream_jpeg_file(const char *infilename, const char *outfilename, int band_height, int options, mj_band_fn fn, void *arg);
 
 void mj_free_jpeg(mj_jpeg_t *m);
 void mj_free_dropon(mj_dropon_t *d);
@@ -147,5 +337,25 @@ int mj_effect_grayscale(mj_jpeg_t *m);
 int mj_effect_pixelate(mj_jpeg_t *m);
 int mj_effect_tint(mj_jpeg_t *m, int cb_value, int cr_value);
 int mj_effect_luminance(mj_jpeg_t *m, int value);
+int mj_effect_contrast(mj_jpeg_t *m, int value);
+int mj_effect_saturation(mj_jpeg_t *m, int value);
+
+int mj_effect_grayscale_rects(mj_jpeg_t *m, const mj_rect_t *rects, int nrects);
+int mj_effect_pixelate_rects(mj_jpeg_t *m, const mj_rect_t *rects, int nrects);
+int mj_effect_tint_rects(mj_jpeg_t *m, int cb_value, int cr_value, const mj_rect_t *rects, int nrects);
+int mj_effect_luminance_rects(mj_jpeg_t *m, int value, const mj_rect_t *rects, int nrects);
+int mj_effect_contrast_rects(mj_jpeg_t *m, int value, const mj_rect_t *rects, int nrects);
+int mj_effect_saturation_rects(mj_jpeg_t *m, int value, const mj_rect_t *rects, int nrects);
+
+mj_pipeline_t *mj_create_pipeline(void);
+int            mj_pipeline_grayscale(mj_pipeline_t *p);
+int            mj_pipeline_pixelate(mj_pipeline_t *p);
+int            mj_pipeline_tint(mj_pipeline_t *p, int cb_value, int cr_value);
+int            mj_pipeline_luminance(mj_pipeline_t *p, int value);
+int            mj_pipeline_contrast(mj_pipeline_t *p, int value);
+int            mj_pipeline_saturation(mj_pipeline_t *p, int value);
+int            mj_effect_pipeline(mj_jpeg_t *m, mj_pipeline_t *p);
+int            mj_effect_pipeline_rects(mj_jpeg_t *m, mj_pipeline_t *p, const mj_rect_t *rects, int nrects);
+void           mj_free_pipeline(mj_pipeline_t *p);
 
 #endif
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "marker.h"
+
+#include "libmodjpeg.h"
+
+#include <string.h>
+
+static int  mj_keep_marker(int markers, int marker, const unsigned char *data, size_t len, size_t original_len, int *orientation);
+static int  mj_get_orientation(const unsigned char *data, size_t len);
+static void mj_orientation_marker(unsigned char *segment, int orientation);
+
+void mj_save_markers(struct jpeg_decompress_struct *cinfo, int markers) {
+    int i;
+
+    // a length limit of 0 skips the marker
+    jpeg_save_markers(cinfo, JPEG_COM, (markers & MJ_MARKER_COM) != 0 ? 0xFFFF : 0);
+
+    for(i = 0; i < 16; i++) {
+        if((markers & MJ_MARKER_APP(i)) != 0) {
+            jpeg_save_markers(cinfo, JPEG_APP0 + i, 0xFFFF);
+        }
+        else if(i == 1 && (markers & MJ_MARKER_ORIENTATION) != 0) {
+            jpeg_save_markers(cinfo, JPEG_APP0 + i, MJ_MARKER_EXIF_PREFIX);
+        }
+        else if(i == 2 && (markers & MJ_MARKER_ICC) != 0) {
+            jpeg_save_markers(cinfo, JPEG_APP0 + i, 0xFFFF);
+        }
+        else {
+            jpeg_save_markers(cinfo, JPEG_APP0 + i, 0);
+        }
+    }
+
+    return;
+}
+
+void mj_write_markers(struct jpeg_compress_struct *cinfo, jpeg_saved_marker_ptr list, int nmarkers, int markers) {
+    // nmarkers < 0 writes all markers in the list. the next pointer of the last of nmarkers markers is not
+    // read, another thread may be appending to the list.
+    jpeg_saved_marker_ptr marker;
+    unsigned char         segment[MJ_MARKER_ORIENTATION_LEN];
+    int                   i, orientation;
+
+    for(marker = (nmarkers != 0 ? list : NULL), i = 0; marker != NULL; marker = (++i != nmarkers ? marker->next : NULL)) {
+        if(mj_keep_marker(markers, marker->marker, marker->data, marker->data_length, marker->original_length, &orientation) == 1) {
+            jpeg_write_marker(cinfo, marker->marker, marker->data, marker->data_length);
+        }
+        else if(orientation != 0) {
+            mj_orientation_marker(segment, orientation);
+            jpeg_write_marker(cinfo, JPEG_APP0 + 1, segment + 4, MJ_MARKER_ORIENTATION_LEN - 4);
+        }
+    }
+
+    return;
+}
+
+size_t mj_filter_markers(unsigned char *dst, const unsigned char *src, size_t len, int markers) {
+    // copy the marker segments in src to dst without the markers that are not kept. dst needs
+    // room for len + MJ_MARKER_ORIENTATION_LEN bytes.
+    size_t pos = 0, n = 0, length;
+    int    marker, orientation;
+
+    while(pos + 4 <= len) {
+        marker = src[pos + 1];
+
+        // fill bytes
+        if(src[pos] != 0xFF || marker == 0xFF) {
+            dst[n++] = src[pos++];
+            continue;
+        }
+
+        // SOI has no segment
+        if(marker == 0xD8) {
+            memcpy(dst + n, src + pos, 2);
+            n += 2;
+            pos += 2;
+            continue;
+        }
+
+        length = 2 + (((size_t)src[pos + 2] << 8) | src[pos + 3]);
+        if(pos + length > len) {
+            length = len - pos;
+        }
+
+        if(marker != JPEG_COM && (marker < JPEG_APP0 || marker > JPEG_APP0 + 15)) {
+            memcpy(dst + n, src + pos, length);
+            n += length;
+        }
+        else if(mj_keep_marker(markers, marker, src + pos + 4, length - 4, length - 4, &orientation) == 1) {
+            memcpy(dst + n, src + pos, length);
+            n += length;
+        }
+        else if(orientation != 0) {
+            mj_orientation_marker(dst + n, orientation);
+            n += MJ_MARKER_ORIENTATION_LEN;
+        }
+
+        pos += length;
+    }
+
+    if(pos < len) {
+        memcpy(dst + n, src + pos, len - pos);
+        n += len - pos;
+    }
+
+    return n;
+}
+
+void mj_copy_markers(struct jpeg_decompress_struct *dst, struct jpeg_decompress_struct *src) {
+    // copies the saved markers into the image pool of dst, like libjpeg saves them
+    jpeg_saved_marker_ptr marker, copy, *next = &dst->marker_list;
+
+    for(marker = src->marker_list; marker != NULL; marker = marker->next) {
+        copy = (jpeg_saved_marker_ptr)(*dst->mem->alloc_large)((j_common_ptr)dst, JPOOL_IMAGE, sizeof(struct jpeg_marker_struct) + marker->data_length);
+
+        copy->next = NULL;
+        copy->marker = marker->marker;
+        copy->original_length = marker->original_length;
+        copy->data_length = marker->data_length;
+        copy->data = (JOCTET *)(copy + 1);
+        memcpy(copy->data, marker->data, marker->data_length);
+
+        *next = copy;
+        next = &copy->next;
+    }
+
+    return;
+}
+
+static int mj_keep_marker(int markers, int marker, const unsigned char *data, size_t len, size_t original_len, int *orientation) {
+    // returns 1 if the marker is kept as it is, 0 otherwise. in that case orientation is set if an
+    // APP1 marker with only the orientation should be written instead.
+    *orientation = 0;
+
+    if(marker == JPEG_COM) {
+        return (markers & MJ_MARKER_COM) != 0 ? 1 : 0;
+    }
+
+    if(marker == JPEG_APP0 + 2 && (markers & MJ_MARKER_NO_ICC) != 0 && len >= 12 && memcmp(data, "ICC_PROFILE\0", 12) == 0) {
+        return 0;
+    }
+
+    // a marker that has only been saved partially can't be written as it is
+    if((markers & MJ_MARKER_APP(marker - JPEG_APP0)) != 0 && len == original_len) {
+        return 1;
+    }
+
+    if(marker == JPEG_APP0 + 1 && (markers & (MJ_MARKER_ORIENTATION | MJ_MARKER_APP(1))) != 0) {
+        *orientation = mj_get_orientation(data, len);
+    }
+    else if(marker == JPEG_APP0 + 2 && (markers & MJ_MARKER_ICC) != 0 && len == original_len) {
+        if(len >= 12 && memcmp(data, "ICC_PROFILE\0", 12) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int mj_get_orientation(const unsigned char *data, size_t len) {
+    // the orientation tag in IFD0 of the EXIF data
+    const unsigned char *tiff;
+    size_t               n, offset, count, i;
+    int                  little, tag, type, value;
+
+    if(len < 6 + 8 || memcmp(data, "Exif\0\0", 6) != 0) {
+        return 0;
+    }
+
+    tiff = data + 6;
+    n = len - 6;
+
+    if(tiff[0] == 'I' && tiff[1] == 'I') {
+        little = 1;
+    }
+    else if(tiff[0] == 'M' && tiff[1] == 'M') {
+        little = 0;
+    }
+    else {
+        return 0;
+    }
+
+#define MJ_GET16(p) (little == 1 ? ((p)[0] | ((p)[1] << 8)) : (((p)[0] << 8) | (p)[1]))
+#define MJ_GET32(p) (little == 1 ? ((size_t)MJ_GET16(p) | ((size_t)MJ_GET16((p) + 2) << 16)) : (((size_t)MJ_GET16(p) << 16) | (size_t)MJ_GET16((p) + 2)))
+
+    offset = MJ_GET32(tiff + 4);
+    if(offset > n || n - offset < 2) {
+        return 0;
+    }
+
+    count = MJ_GET16(tiff + offset);
+    offset += 2;
+
+    for(i = 0; i < count && n - offset >= 12; i++, offset += 12) {
+        tag = MJ_GET16(tiff + offset);
+        type = MJ_GET16(tiff + offset + 2);
+
+        // a SHORT with a single value
+        if(tag == 0x0112 && type == 3 && MJ_GET32(tiff + offset + 4) == 1) {
+            value = MJ_GET16(tiff + offset + 8);
+            return (value >= 1 && value <= 8) ? value : 0;
+        }
+    }
+
+#undef MJ_GET16
+#undef MJ_GET32
+
+    return 0;
+}
+
+static void mj_orientation_marker(unsigned char *segment, int orientation) {
+    // an APP1 marker with EXIF data that only holds an IFD0 with the orientation
+    static const unsigned char exif[MJ_MARKER_ORIENTATION_LEN] = {
+        0xFF, 0xE1, 0x00, 0x22,
+        'E', 'x', 'i', 'f', 0x00, 0x00,
+        'M', 'M', 0x00, 0x2A, 0x00, 0x00, 0x00, 0x08,
+        0x00, 0x01,
+        0x01, 0x12, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00,
+    };
+
+    memcpy(segment, exif, MJ_MARKER_ORIENTATION_LEN);
+    segment[29] = (unsigned char)orientation;
+
+    return;
+}
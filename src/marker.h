@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_MARKER_H_
+#define _LIBMODJPEG_MARKER_H_
+
+#include "libmodjpeg.h"
+
+// only the start of an APP1 marker is saved if nothing but the orientation is kept from it
+#define MJ_MARKER_EXIF_PREFIX 4096
+
+// the length of an APP1 marker that only holds the orientation, including the marker and the length field
+#define MJ_MARKER_ORIENTATION_LEN 36
+
+// drops APP2 markers with an ICC profile even if all APP2 markers are kept. the profile of a color
+// JPEG doesn't fit the grayscale JPEG written from it.
+#define MJ_MARKER_NO_ICC (1 << 30)
+
+void   mj_save_markers(struct jpeg_decompress_struct *cinfo, int markers);
+void   mj_write_markers(struct jpeg_compress_struct *cinfo, jpeg_saved_marker_ptr list, int nmarkers, int markers);
+size_t mj_filter_markers(unsigned char *dst, const unsigned char *src, size_t len, int markers);
+void   mj_copy_markers(struct jpeg_decompress_struct *dst, struct jpeg_decompress_struct *src);
+
+#endif
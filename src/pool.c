@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pool.h"
+
+#include "libmodjpeg.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct mj_pool_worker {
+    mj_pool_t *pool;
+    int        worker;
+};
+
+// the pool whose tasks the current thread is executing, NULL otherwise
+static _Thread_local mj_pool_t *mj_pool_current = NULL;
+
+static void  mj_pool_work(mj_pool_t *pool, int worker);
+static void *mj_pool_thread(void *arg);
+
+mj_pool_t *mj_create_pool(int nworkers) {
+    if(nworkers <= 0) {
+        nworkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if(nworkers <= 0) {
+            nworkers = 1;
+        }
+    }
+
+    mj_pool_t *pool = (mj_pool_t *)calloc(1, sizeof(mj_pool_t));
+    if(pool == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->run, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // the calling thread is the first worker
+    pool->threads = (pthread_t *)calloc(nworkers, sizeof(pthread_t));
+    if(pool->threads == NULL) {
+        mj_free_pool(pool);
+        return NULL;
+    }
+
+    struct mj_pool_worker *w;
+    int                    i;
+
+    for(i = 1; i < nworkers; i++) {
+        w = (struct mj_pool_worker *)malloc(sizeof(struct mj_pool_worker));
+        if(w == NULL) {
+            mj_free_pool(pool);
+            return NULL;
+        }
+
+        w->pool = pool;
+        w->worker = i;
+
+        if(pthread_create(&pool->threads[pool->nthreads], NULL, mj_pool_thread, w) != 0) {
+            free(w);
+            mj_free_pool(pool);
+            return NULL;
+        }
+
+        pool->nthreads++;
+    }
+
+    return pool;
+}
+
+void mj_free_pool(mj_pool_t *pool) {
+    if(pool == NULL) {
+        return;
+    }
+
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    free(pool->threads);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run);
+
+    free(pool);
+
+    return;
+}
+
+int mj_pool_nworkers(mj_pool_t *pool) {
+    if(pool == NULL) {
+        return 1;
+    }
+
+    return pool->nthreads + 1;
+}
+
+void mj_pool_run(mj_pool_t *pool, mj_task_fn fn, void *arg, int ntasks) {
+    int i;
+
+    // without a pool or threads all tasks are executed by the calling thread. the same goes for a run
+    // that is started from a task of the same pool, the other workers are busy with the outer run.
+    if(pool == NULL || pool->nthreads == 0 || mj_pool_current == pool) {
+        for(i = 0; i < ntasks; i++) {
+            fn(arg, i, 0);
+        }
+
+        return;
+    }
+
+    pthread_mutex_lock(&pool->run);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->ntasks = ntasks;
+    pool->next = 0;
+    pool->running = pool->nthreads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    mj_pool_current = pool;
+    mj_pool_work(pool, 0);
+    mj_pool_current = NULL;
+
+    // wait for the other workers to finish their last task
+    pthread_mutex_lock(&pool->lock);
+    while(pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pool->fn = NULL;
+    pool->arg = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->run);
+
+    return;
+}
+
+static void mj_pool_work(mj_pool_t *pool, int worker) {
+    int task;
+
+    for(;;) {
+        pthread_mutex_lock(&pool->lock);
+        task = pool->next;
+        if(task < pool->ntasks) {
+            pool->next++;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        if(task >= pool->ntasks) {
+            break;
+        }
+
+        pool->fn(pool->arg, task, worker);
+    }
+
+    return;
+}
+
+static void *mj_pool_thread(void *arg) {
+    struct mj_pool_worker *w = (struct mj_pool_worker *)arg;
+    mj_pool_t *            pool = w->pool;
+    int                    worker = w->worker;
+    unsigned long          generation = 0;
+
+    free(w);
+
+    mj_pool_current = pool;
+
+    for(;;) {
+        pthread_mutex_lock(&pool->lock);
+        while(pool->shutdown == 0 && pool->generation == generation) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+
+        if(pool->shutdown != 0) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        mj_pool_work(pool, worker);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->running--;
+        if(pool->running == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_POOL_H_
+#define _LIBMODJPEG_POOL_H_
+
+#include "libmodjpeg.h"
+
+#include <pthread.h>
+
+// a task gets the argument of the run, the number of the task, and the number of the
+// worker that executes it (0 ... nworkers - 1). worker 0 is the calling thread.
+typedef void (*mj_task_fn)(void *arg, int task, int worker);
+
+struct mj_pool {
+    pthread_mutex_t run;     // serializes calls to mj_pool_run() from outside of the pool
+    pthread_mutex_t lock;    // protects everything below
+    pthread_cond_t  start;
+    pthread_cond_t  done;
+
+    pthread_t *threads;
+    int        nthreads;
+    int        shutdown;
+
+    unsigned long generation;
+
+    mj_task_fn fn;
+    void *     arg;
+    int        ntasks;
+    int        next;
+    int        running;
+};
+
+void mj_pool_run(mj_pool_t *pool, mj_task_fn fn, void *arg, int ntasks);
+int  mj_pool_nworkers(mj_pool_t *pool);
+
+#endif
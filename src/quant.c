@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "quant.h"
+
+#include "libmodjpeg.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pthread_once_t       mj_quantize_block_once = PTHREAD_ONCE_INIT;
+static mj_quantize_block_fn mj_quantize_block = mj_quantize_block_reference;
+
+static void mj_init_quantize_block(void);
+
+void mj_init_quanttable(mj_quanttable_t *qt, const JQUANT_TBL *table) {
+    int          i;
+    unsigned int l;
+
+    for(i = 0; i < DCTSIZE2; i++) {
+        qt->quantval[i] = 1;
+        if(table != NULL && table->quantval[i] != 0) {
+            qt->quantval[i] = table->quantval[i];
+        }
+
+        // with l = ceil(log2(q)), k = 31 + l, and m = floor(2^k / q) + 1, x * m < 2^63 and
+        // floor(x * m / 2^k) == floor(x / q) for all 0 <= x < 2^31. m fits in 32 bits.
+        l = 0;
+        while((1U << l) < qt->quantval[i]) {
+            l++;
+        }
+
+        qt->shift[i] = 31 + l;
+        qt->multiplier[i] = (unsigned int)(((unsigned long long)1 << qt->shift[i]) / qt->quantval[i] + 1);
+    }
+
+    return;
+}
+
+void mj_dequantize_block(const mj_quanttable_t *qt, const JCOEF *coefs, int *values) {
+    int i;
+
+    for(i = 0; i < DCTSIZE2; i += 8) {
+        values[i + 0] = coefs[i + 0] * qt->quantval[i + 0];
+        values[i + 1] = coefs[i + 1] * qt->quantval[i + 1];
+        values[i + 2] = coefs[i + 2] * qt->quantval[i + 2];
+        values[i + 3] = coefs[i + 3] * qt->quantval[i + 3];
+        values[i + 4] = coefs[i + 4] * qt->quantval[i + 4];
+        values[i + 5] = coefs[i + 5] * qt->quantval[i + 5];
+        values[i + 6] = coefs[i + 6] * qt->quantval[i + 6];
+        values[i + 7] = coefs[i + 7] * qt->quantval[i + 7];
+    }
+
+    return;
+}
+
+int mj_quantize_value(const mj_quanttable_t *qt, int i, int value) {
+    unsigned int x = value < 0 ? 0U - (unsigned int)value : (unsigned int)value;
+    int          q = (int)(((unsigned long long)x * qt->multiplier[i]) >> qt->shift[i]);
+
+    if(value < 0) {
+        q = -q;
+    }
+
+    if(q > 32767) {
+        q = 32767;
+    }
+    else if(q < -32768) {
+        q = -32768;
+    }
+
+    return q;
+}
+
+void mj_quantize_block_reference(const mj_quanttable_t *qt, const int *values, JCOEFPTR coefs) {
+    int i;
+
+    for(i = 0; i < DCTSIZE2; i++) {
+        coefs[i] = (JCOEF)mj_quantize_value(qt, i, values[i]);
+    }
+
+    return;
+}
+
+static void mj_init_quantize_block(void) {
+    // the same as for the blending, see mj_init_blend_block()
+    const char *simd = getenv("MODJPEG_SIMD");
+
+    if(simd != NULL && strcmp(simd, "none") == 0) {
+        return;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+
+    if(simd != NULL && strcmp(simd, "sse2") == 0) {
+        return;
+    }
+
+    if(__builtin_cpu_supports("avx2")) {
+        mj_quantize_block = mj_quantize_block_avx2;
+    }
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+    mj_quantize_block = mj_quantize_block_neon;
+#endif
+
+    return;
+}
+
+mj_quantize_block_fn mj_get_quantize_block(void) {
+    pthread_once(&mj_quantize_block_once, mj_init_quantize_block);
+
+    return mj_quantize_block;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_QUANT_H_
+#define _LIBMODJPEG_QUANT_H_
+
+#include "libmodjpeg.h"
+
+// requantizes the values of a block, i.e. coefs[i] = values[i] / quantval[i], truncated towards zero
+// like an integer division and saturated to 16 bits. all implementations give the same result.
+typedef void (*mj_quantize_block_fn)(const mj_quanttable_t *qt, const int *values, JCOEFPTR coefs);
+
+void mj_init_quanttable(mj_quanttable_t *qt, const JQUANT_TBL *table);
+
+void                 mj_dequantize_block(const mj_quanttable_t *qt, const JCOEF *coefs, int *values);
+int                  mj_quantize_value(const mj_quanttable_t *qt, int i, int value);
+void                 mj_quantize_block_reference(const mj_quanttable_t *qt, const int *values, JCOEFPTR coefs);
+mj_quantize_block_fn mj_get_quantize_block(void);
+
+#if defined(__x86_64__) || defined(__i386__)
+void mj_quantize_block_avx2(const mj_quanttable_t *qt, const int *values, JCOEFPTR coefs);
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+void mj_quantize_block_neon(const mj_quanttable_t *qt, const int *values, JCOEFPTR coefs);
+#endif
+
+#endif
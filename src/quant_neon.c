@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "quant.h"
+
+#include "libmodjpeg.h"
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+
+#    include <arm_neon.h>
+
+// the division of 2 absolute values with a 32 x 32 -> 64 bit multiplication and a shift to the right
+static inline uint32x2_t mj_quantize_neon(uint32x2_t a, uint32x2_t multiplier, uint32x2_t shift) {
+    int64x2_t count = vnegq_s64(vreinterpretq_s64_u64(vmovl_u32(shift)));
+
+    return vmovn_u64(vshlq_u64(vmull_u32(a, multiplier), count));
+}
+
+void mj_quantize_block_neon(const mj_quanttable_t *qt, const int *values, JCOEFPTR coefs) {
+    int        i;
+    int32x4_t  x, q;
+    uint32x4_t a, m, s;
+
+    for(i = 0; i < DCTSIZE2; i += 4) {
+        x = vld1q_s32(values + i);
+        a = vreinterpretq_u32_s32(vabsq_s32(x));
+        m = vld1q_u32(qt->multiplier + i);
+        s = vld1q_u32(qt->shift + i);
+
+        q = vreinterpretq_s32_u32(vcombine_u32(mj_quantize_neon(vget_low_u32(a), vget_low_u32(m), vget_low_u32(s)), mj_quantize_neon(vget_high_u32(a), vget_high_u32(m), vget_high_u32(s))));
+
+        // restore the sign
+        q = vbslq_s32(vcltq_s32(x, vdupq_n_s32(0)), vnegq_s32(q), q);
+
+        vst1_s16(coefs + i, vqmovn_s32(q));
+    }
+
+    return;
+}
+
+#endif
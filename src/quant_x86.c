@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "quant.h"
+
+#include "libmodjpeg.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#    include <immintrin.h>
+
+// the division of 8 absolute values at once. there's only a 32 x 32 -> 64 bit multiplication of the
+// even elements, the odd elements are moved to the even positions for a second multiplication.
+__attribute__((target("avx2"))) static inline __m256i mj_quantize_avx2(__m256i x, __m256i multiplier, __m256i shift) {
+    const __m256i low = _mm256_set1_epi64x(0xffffffff);
+
+    __m256i a = _mm256_abs_epi32(x);
+
+    __m256i even = _mm256_mul_epu32(a, multiplier);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(multiplier, 32));
+
+    even = _mm256_srlv_epi64(even, _mm256_and_si256(shift, low));
+    odd = _mm256_srlv_epi64(odd, _mm256_srli_epi64(shift, 32));
+
+    // the quotients are less than 2^31, i.e. they are in the lower halves
+    __m256i q = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xaa);
+
+    return _mm256_sign_epi32(q, x);
+}
+
+__attribute__((target("avx2"))) void mj_quantize_block_avx2(const mj_quanttable_t *qt, const int *values, JCOEFPTR coefs) {
+    int     i;
+    __m256i lo, hi;
+
+    for(i = 0; i < DCTSIZE2; i += 16) {
+        lo = mj_quantize_avx2(_mm256_loadu_si256((const __m256i *)(values + i)), _mm256_loadu_si256((const __m256i *)(qt->multiplier + i)), _mm256_loadu_si256((const __m256i *)(qt->shift + i)));
+        hi = mj_quantize_avx2(_mm256_loadu_si256((const __m256i *)(values + i + 8)), _mm256_loadu_si256((const __m256i *)(qt->multiplier + i + 8)), _mm256_loadu_si256((const __m256i *)(qt->shift + i + 8)));
+
+        // packing works within 128 bit lanes, the permutation restores the order
+        _mm256_storeu_si256((__m256i *)(coefs + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8));
+    }
+
+    return;
+}
+
+#endif
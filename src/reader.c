@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "reader.h"
+
+#include "arena.h"
+#include "image.h"
+#include "jpeg.h"
+#include "libmodjpeg.h"
+#include "marker.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void    mj_reader_init_source(j_decompress_ptr cinfo);
+static boolean mj_reader_fill_input_buffer(j_decompress_ptr cinfo);
+static void    mj_reader_skip_input_data(j_decompress_ptr cinfo, long num_bytes);
+static void    mj_reader_term_source(j_decompress_ptr cinfo);
+
+static int mj_reader_decode(mj_reader_t *r);
+static int mj_reader_fail(mj_reader_t *r, int rv);
+
+mj_reader_t *mj_create_reader(mj_jpeg_t *m, size_t max_pixel) {
+    if(m == NULL) {
+        return NULL;
+    }
+
+    mj_free_jpeg(m);
+
+    mj_reader_t *r = (mj_reader_t *)calloc(1, sizeof(mj_reader_t));
+    if(r == NULL) {
+        return NULL;
+    }
+
+    r->m = m;
+    r->max_pixel = max_pixel;
+    r->state = MJ_READER_HEADER;
+    r->rv = MJ_OK;
+
+    m->cinfo.err = jpeg_std_error(&r->jerr.pub);
+    r->jerr.pub.error_exit = mj_jpeg_error_exit;
+    if(setjmp(r->jerr.setjmp_buffer)) {
+        mj_free_jpeg(m);
+        free(r);
+        return NULL;
+    }
+
+    jpeg_create_decompress(&m->cinfo);
+    mj_arena_attach(m->arena, (j_common_ptr)&m->cinfo);
+
+    m->cinfo.src = &r->src;
+    r->src.init_source = mj_reader_init_source;
+    r->src.fill_input_buffer = mj_reader_fill_input_buffer;
+    r->src.skip_input_data = mj_reader_skip_input_data;
+    r->src.resync_to_restart = jpeg_resync_to_restart;
+    r->src.term_source = mj_reader_term_source;
+
+    r->src.next_input_byte = NULL;
+    r->src.bytes_in_buffer = 0;
+
+    // save markers (must happen before jpeg_read_header)
+    mj_save_markers(&m->cinfo, m->markers);
+
+    return r;
+}
+
+int mj_reader_feed(mj_reader_t *r, const unsigned char *bytes, size_t len) {
+    if(r == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    if(r->state == MJ_READER_DONE) {
+        // trailing bytes after the image are ignored
+        return MJ_OK;
+    }
+
+    if(r->state == MJ_READER_FAILED) {
+        return r->rv;
+    }
+
+    if(bytes == NULL || len == 0) {
+        return MJ_OK;
+    }
+
+    r->total += len;
+
+    // a skip that went beyond the bytes fed so far
+    if(r->skip != 0) {
+        if(r->skip >= len) {
+            r->skip -= len;
+            return MJ_OK;
+        }
+
+        bytes += r->skip;
+        len -= r->skip;
+        r->skip = 0;
+    }
+
+    // move the bytes that libjpeg hasn't consumed yet to the front and append the new ones
+    size_t pending = r->src.bytes_in_buffer;
+
+    if(pending != 0 && r->src.next_input_byte != r->buf) {
+        memmove(r->buf, r->src.next_input_byte, pending);
+    }
+
+    if(pending + len > r->size) {
+        size_t  size = r->size == 0 ? 4096 : r->size;
+        JOCTET *buf;
+
+        while(size < pending + len) {
+            size *= 2;
+        }
+
+        buf = (JOCTET *)realloc(r->buf, size);
+        if(buf == NULL) {
+            return mj_reader_fail(r, MJ_ERR_MEMORY);
+        }
+
+        r->buf = buf;
+        r->size = size;
+    }
+
+    memcpy(r->buf + pending, bytes, len);
+
+    r->src.next_input_byte = r->buf;
+    r->src.bytes_in_buffer = pending + len;
+
+    return mj_reader_decode(r);
+}
+
+int mj_reader_finish(mj_reader_t *r) {
+    if(r == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    if(r->state == MJ_READER_DONE) {
+        return MJ_OK;
+    }
+
+    // the input ended before all coefficients have been read
+    if(r->state != MJ_READER_FAILED) {
+        mj_reader_fail(r, MJ_ERR_DECODE_JPEG);
+    }
+
+    return r->rv;
+}
+
+void mj_free_reader(mj_reader_t *r) {
+    if(r == NULL) {
+        return;
+    }
+
+    // an incomplete image is of no use
+    if(r->state != MJ_READER_DONE && r->state != MJ_READER_FAILED) {
+        mj_free_jpeg(r->m);
+    }
+
+    if(r->buf != NULL) {
+        free(r->buf);
+    }
+
+    free(r);
+
+    return;
+}
+
+static int mj_reader_decode(mj_reader_t *r) {
+    mj_jpeg_t *m = r->m;
+
+    if(setjmp(r->jerr.setjmp_buffer)) {
+        return mj_reader_fail(r, MJ_ERR_DECODE_JPEG);
+    }
+
+    if(r->state == MJ_READER_HEADER) {
+        if(jpeg_read_header(&m->cinfo, TRUE) == JPEG_SUSPENDED) {
+            return MJ_OK;
+        }
+
+        m->width = m->cinfo.image_width;
+        m->height = m->cinfo.image_height;
+
+        if(r->max_pixel != 0 && ((size_t)m->width * (size_t)m->height) > r->max_pixel) {
+            return mj_reader_fail(r, MJ_ERR_IMAGE_SIZE);
+        }
+
+        switch(m->cinfo.jpeg_color_space) {
+            case JCS_GRAYSCALE:
+            case JCS_RGB:
+            case JCS_YCbCr:
+                break;
+            default:
+                return mj_reader_fail(r, MJ_ERR_UNSUPPORTED_COLORSPACE);
+        }
+
+        r->state = MJ_READER_COEFFICIENTS;
+    }
+
+    if(r->state == MJ_READER_COEFFICIENTS) {
+        m->coef = jpeg_read_coefficients(&m->cinfo);
+        if(m->coef == NULL) {
+            return MJ_OK;
+        }
+
+        m->len = r->total;
+
+        mj_setup_jpeg(m);
+
+        r->state = MJ_READER_DONE;
+    }
+
+    return MJ_OK;
+}
+
+static int mj_reader_fail(mj_reader_t *r, int rv) {
+    mj_free_jpeg(r->m);
+
+    r->state = MJ_READER_FAILED;
+    r->rv = rv;
+
+    return rv;
+}
+
+static void mj_reader_init_source(j_decompress_ptr cinfo) {
+    /* no work necessary here */
+}
+
+static boolean mj_reader_fill_input_buffer(j_decompress_ptr cinfo) {
+    // suspend until more bytes are fed
+    return FALSE;
+}
+
+static void mj_reader_skip_input_data(j_decompress_ptr cinfo, long num_bytes) {
+    mj_reader_t *r = (mj_reader_t *)cinfo->src;
+
+    if(num_bytes <= 0) {
+        return;
+    }
+
+    if((size_t)num_bytes > r->src.bytes_in_buffer) {
+        r->skip += (size_t)num_bytes - r->src.bytes_in_buffer;
+        num_bytes = (long)r->src.bytes_in_buffer;
+    }
+
+    r->src.next_input_byte += (size_t)num_bytes;
+    r->src.bytes_in_buffer -= (size_t)num_bytes;
+}
+
+static void mj_reader_term_source(j_decompress_ptr cinfo) {
+    /* no work necessary here */
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_READER_H_
+#define _LIBMODJPEG_READER_H_
+
+#include "jpeg.h"
+#include "libmodjpeg.h"
+
+#define MJ_READER_HEADER       0
+#define MJ_READER_COEFFICIENTS 1
+#define MJ_READER_DONE         2
+#define MJ_READER_FAILED       3
+
+struct mj_reader {
+    struct jpeg_source_mgr   src;    // must be the first member, the source manager methods get the reader from it
+    struct mj_jpeg_error_mgr jerr;
+
+    mj_jpeg_t *m;
+    size_t     max_pixel;
+
+    JOCTET *buf;      // holds the bytes that libjpeg hasn't consumed yet
+    size_t  size;
+    size_t  skip;     // the number of bytes to skip of the bytes that are still to come
+    size_t  total;    // the number of bytes fed so far
+
+    int state;
+    int rv;
+};
+
+#endif
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "scale.h"
+
+#include "dct.h"
+#include "image.h"
+#include "libmodjpeg.h"
+
+#include <string.h>
+
+static void mj_downscale_init(mj_scale_t *s, int denom);
+static void mj_downscale_component(mj_jpeg_t *dst, mj_jpeg_t *src, int component, const mj_scale_t *s);
+static void mj_downscale_block(const mj_scale_t *s, JBLOCKROW *rows, const JDIMENSION *cols, const mj_quanttable_t *qt, JCOEFPTR coefs);
+static int  mj_downscale_round(float value, int limit);
+
+int mj_downscale(mj_jpeg_t *dst, mj_jpeg_t *src, int denom) {
+    if(dst == NULL || src == NULL || dst == src || src->coef == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    if(denom != 2 && denom != 4 && denom != 8) {
+        return MJ_ERR_UNSUPPORTED_SCALE;
+    }
+
+    // a band of a streamed image doesn't have the blocks of the other bands
+    if(src->band_end != 0) {
+        return MJ_ERR_UNSUPPORTED_STREAMING;
+    }
+
+    mj_scale_t s;
+    int        c;
+
+    mj_free_jpeg(dst);
+
+    // the dimensions are rounded up like libjpeg does for scaled decoding
+    if(mj_derive_jpeg(dst, src, (src->cinfo.image_width + denom - 1) / denom, (src->cinfo.image_height + denom - 1) / denom) != MJ_OK) {
+        mj_free_jpeg(dst);
+        return MJ_ERR_MEMORY;
+    }
+
+    dst->len = src->len / (denom * denom);
+
+    mj_downscale_init(&s, denom);
+
+    for(c = 0; c < dst->cinfo.num_components; c++) {
+        mj_downscale_component(dst, src, c, &s);
+    }
+
+    return MJ_OK;
+}
+
+static void mj_downscale_init(mj_scale_t *s, int denom) {
+    // the basis of the DCT with size points is every denom-th row of the 8-point basis scaled by sqrt(denom). this
+    // cancels out with the scale of sqrt(1 / denom) that turns the low coefficients of a block into reduced samples.
+    int   j, u, t, x;
+    float sum;
+
+    s->denom = denom;
+    s->size = DCTSIZE / denom;
+
+    for(j = 0; j < denom; j++) {
+        for(u = 0; u < DCTSIZE; u++) {
+            for(t = 0; t < s->size; t++) {
+                sum = 0.0;
+                for(x = 0; x < s->size; x++) {
+                    sum += mj_dct_matrix[u][j * s->size + x] * mj_dct_matrix[t * denom][x];
+                }
+
+                s->merge[j][u][t] = sum;
+            }
+        }
+    }
+
+    return;
+}
+
+static void mj_downscale_component(mj_jpeg_t *dst, mj_jpeg_t *src, int component, const mj_scale_t *s) {
+    jpeg_component_info *incomp = &src->cinfo.comp_info[component];
+    jpeg_component_info *outcomp = &dst->cinfo.comp_info[component];
+    JBLOCKARRAY          blocks;
+    JBLOCKROW            rows[DCTSIZE];
+    JDIMENSION           cols[DCTSIZE];
+    JDIMENSION           by, bx, n;
+    int                  j;
+
+    for(by = 0; by < outcomp->height_in_blocks; by++) {
+        // the blocks beyond the edges of src are replaced by the last row or column of blocks. the arrays are
+        // completely in memory, the rows stay valid after accessing the next one.
+        for(j = 0; j < s->denom; j++) {
+            n = by * s->denom + j;
+            if(n >= incomp->height_in_blocks) {
+                n = incomp->height_in_blocks - 1;
+            }
+
+            blocks = (*src->cinfo.mem->access_virt_barray)((j_common_ptr)&src->cinfo, src->coef[component], n, 1, FALSE);
+            rows[j] = blocks[0];
+        }
+
+        blocks = (*dst->cinfo.mem->access_virt_barray)((j_common_ptr)&dst->cinfo, dst->coef[component], by, 1, TRUE);
+
+        for(bx = 0; bx < outcomp->width_in_blocks; bx++) {
+            for(j = 0; j < s->denom; j++) {
+                cols[j] = bx * s->denom + j;
+                if(cols[j] >= incomp->width_in_blocks) {
+                    cols[j] = incomp->width_in_blocks - 1;
+                }
+            }
+
+            mj_downscale_block(s, rows, cols, &src->quant[component], blocks[0][bx]);
+        }
+    }
+
+    return;
+}
+
+static void mj_downscale_block(const mj_scale_t *s, JBLOCKROW *rows, const JDIMENSION *cols, const mj_quanttable_t *qt, JCOEFPTR coefs) {
+    // the merged block is the sum of merge[j] * X * merge[k]' of the low coefficients X of the blocks
+    float y[DCTSIZE2], t[DCTSIZE2], x[DCTSIZE2], sum;
+    int   j, k, u, v, w;
+
+    memset(y, 0, sizeof(y));
+
+    for(j = 0; j < s->denom; j++) {
+        for(k = 0; k < s->denom; k++) {
+            const JCOEF *block = rows[j][cols[k]];
+
+            for(u = 0; u < s->size; u++) {
+                for(v = 0; v < s->size; v++) {
+                    x[u * s->size + v] = (float)(block[u * DCTSIZE + v] * qt->quantval[u * DCTSIZE + v]);
+                }
+            }
+
+            // t = X * merge[k]'
+            for(u = 0; u < s->size; u++) {
+                for(v = 0; v < DCTSIZE; v++) {
+                    sum = 0.0;
+                    for(w = 0; w < s->size; w++) {
+                        sum += x[u * s->size + w] * s->merge[k][v][w];
+                    }
+
+                    t[u * DCTSIZE + v] = sum;
+                }
+            }
+
+            // y += merge[j] * t
+            for(u = 0; u < DCTSIZE; u++) {
+                for(v = 0; v < DCTSIZE; v++) {
+                    sum = 0.0;
+                    for(w = 0; w < s->size; w++) {
+                        sum += s->merge[j][u][w] * t[w * DCTSIZE + v];
+                    }
+
+                    y[u * DCTSIZE + v] += sum;
+                }
+            }
+        }
+    }
+
+    coefs[0] = (JCOEF)mj_downscale_round(y[0] / qt->quantval[0], MJ_SCALE_MAX_DC);
+
+    for(u = 1; u < DCTSIZE2; u++) {
+        coefs[u] = (JCOEF)mj_downscale_round(y[u] / qt->quantval[u], MJ_SCALE_MAX_AC);
+    }
+
+    return;
+}
+
+static int mj_downscale_round(float value, int limit) {
+    // rounds half away from zero and clamps to [-limit, limit]
+    int v;
+
+    if(value >= (float)limit) {
+        return limit;
+    }
+
+    if(value <= (float)-limit) {
+        return -limit;
+    }
+
+    if(value < 0.0) {
+        v = -(int)(0.5 - value);
+    }
+    else {
+        v = (int)(value + 0.5);
+    }
+
+    return v;
+}
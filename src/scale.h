@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_SCALE_H_
+#define _LIBMODJPEG_SCALE_H_
+
+#include "libmodjpeg.h"
+
+#define MJ_SCALE_MAX_DC 2047    // the limits of the quantized coefficients of a baseline JPEG
+#define MJ_SCALE_MAX_AC 1023
+
+// merges denom x denom blocks into one block. the low size x size coefficients of a block are its samples
+// reduced by denom, and the reduced samples of the blocks are transformed together into one block. both steps
+// are linear, such that the block at (j, k) contributes merge[j] * X * merge[k]' to the merged block.
+typedef struct {
+    int   denom;
+    int   size;                             // DCTSIZE / denom
+    float merge[DCTSIZE][DCTSIZE][DCTSIZE];    // merge[j][u][t]
+} mj_scale_t;
+
+#endif
@@ -0,0 +1,569 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "splice.h"
+
+#include "arena.h"
+#include "libmodjpeg.h"
+#include "marker.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// the longest a block can get in the entropy-coded data, including stuffed bytes and pending bits
+#define MJ_SPLICE_MAX_BLOCKSIZE 1024
+
+// splice only if at most 1 / MJ_SPLICE_MAX_MODIFIED of the restart segments have been modified
+#define MJ_SPLICE_MAX_MODIFIED 3
+
+// the position of the coefficients of a block in zigzag order
+static const int mj_zigzag[DCTSIZE2] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+    41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+    30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// the number of bits of the values 0 to 255
+static const unsigned char mj_nbits[256] = {
+    0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+    8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+};
+
+static int  mj_find_segments(mj_original_t *o, size_t *bounds);
+static int  mj_encode_segment(mj_jpeg_t *m, mj_bitwriter_t *w, int segment, mj_huffcode_t *dc, mj_huffcode_t *ac);
+static int  mj_encode_block(mj_bitwriter_t *w, const JCOEF *coefs, int *last_dc, const mj_huffcode_t *dc, const mj_huffcode_t *ac);
+static int  mj_derive_huffcode(const JHUFF_TBL *table, mj_huffcode_t *hc);
+static int  mj_count_bits(int value);
+static int  mj_reserve(mj_bitwriter_t *w, size_t n);
+static void mj_append(mj_bitwriter_t *w, const unsigned char *data, size_t n);
+static void mj_put_bits(mj_bitwriter_t *w, unsigned int code, int size);
+static void mj_write_bytes(mj_bitwriter_t *w);
+static void mj_flush_bits(mj_bitwriter_t *w);
+
+int mj_splice_init(mj_jpeg_t *m, const unsigned char *memory, size_t len, size_t scan) {
+    struct jpeg_decompress_struct *cinfo = &m->cinfo;
+    mj_original_t *                o = &m->original;
+    int                            i;
+
+    // restart segments can only be copied if they are coded independently of the rest of the image
+    if(cinfo->restart_interval == 0 || cinfo->progressive_mode == TRUE || cinfo->arith_code == TRUE || cinfo->data_precision != 8) {
+        return MJ_OK;
+    }
+
+    if(jpeg_has_multiple_scans(cinfo) == TRUE || cinfo->comps_in_scan != cinfo->num_components || scan >= len) {
+        return MJ_OK;
+    }
+
+    o->ncomponents = cinfo->comps_in_scan;
+    for(i = 0; i < o->ncomponents; i++) {
+        o->components[i] = cinfo->cur_comp_info[i]->component_index;
+    }
+
+    // in a scan with a single component, each block is an MCU
+    if(o->ncomponents == 1) {
+        o->mcus_per_row = (int)cinfo->cur_comp_info[0]->width_in_blocks;
+        o->nmcus = o->mcus_per_row * (int)cinfo->cur_comp_info[0]->height_in_blocks;
+    }
+    else {
+        o->mcus_per_row = (int)((cinfo->image_width + cinfo->max_h_samp_factor * DCTSIZE - 1) / (cinfo->max_h_samp_factor * DCTSIZE));
+        o->nmcus = o->mcus_per_row * (int)cinfo->total_iMCU_rows;
+    }
+
+    o->restart_interval = (int)cinfo->restart_interval;
+    o->nsegments = (o->nmcus + o->restart_interval - 1) / o->restart_interval;
+
+    if(o->nsegments == 0) {
+        return MJ_OK;
+    }
+
+    o->data = (unsigned char *)mj_alloc(m->arena, len + MJ_MARKER_ORIENTATION_LEN);
+    o->modified = (unsigned char *)mj_alloc(m->arena, o->nsegments * sizeof(unsigned char));
+    if(o->data == NULL || o->modified == NULL) {
+        mj_splice_free(m);
+        return MJ_ERR_MEMORY;
+    }
+
+    // the markers that are not kept are not copied
+    o->scan = mj_filter_markers(o->data, memory, scan, m->markers);
+    memcpy(o->data + o->scan, memory + scan, len - scan);
+    o->len = o->scan + len - scan;
+
+    return MJ_OK;
+}
+
+void mj_splice_mark(mj_jpeg_t *m, int component, int row_start, int row_end, int col_start, int col_end) {
+    mj_original_t *o = &m->original;
+    int            h = 1, v = 1;
+    int            mcu_row, mcu_start, mcu_end, segment;
+
+    if(o->modified == NULL || row_start >= row_end || col_start >= col_end) {
+        return;
+    }
+
+    if(o->ncomponents > 1) {
+        h = m->cinfo.comp_info[component].h_samp_factor;
+        v = m->cinfo.comp_info[component].v_samp_factor;
+    }
+
+    col_start /= h;
+    col_end = (col_end - 1) / h;
+    if(col_end >= o->mcus_per_row) {
+        col_end = o->mcus_per_row - 1;
+    }
+
+    for(mcu_row = row_start / v; mcu_row <= (row_end - 1) / v; mcu_row++) {
+        mcu_start = mcu_row * o->mcus_per_row + col_start;
+        mcu_end = mcu_row * o->mcus_per_row + col_end;
+        if(mcu_end >= o->nmcus) {
+            break;
+        }
+
+        for(segment = mcu_start / o->restart_interval; segment <= mcu_end / o->restart_interval; segment++) {
+            o->modified[segment] = 1;
+        }
+    }
+
+    return;
+}
+
+int mj_splice_jpeg(mj_jpeg_t *m, unsigned char **memory, size_t *len, int options) {
+    struct jpeg_decompress_struct *cinfo = &m->cinfo;
+    mj_original_t *                o = &m->original;
+    mj_huffcode_t                  dc[MAX_COMPS_IN_SCAN], ac[MAX_COMPS_IN_SCAN];
+    mj_bitwriter_t                 w;
+    size_t *                       bounds;
+    int                            i, n, rv = MJ_OK;
+    unsigned char                  marker[2];
+
+    // the segments can only be copied into a baseline JPEG with the same components and Huffman tables
+    if(o->data == NULL || (options & (MJ_OPTION_OPTIMIZE | MJ_OPTION_PROGRESSIVE | MJ_OPTION_ARITHMETRIC | MJ_OPTION_GRAYSCALE)) != 0) {
+        return MJ_ERR_ENCODE_JPEG;
+    }
+
+    // libjpeg encodes a whole image faster if a large part of it has been modified
+    for(i = 0, n = 0; i < o->nsegments; i++) {
+        n += o->modified[i];
+    }
+
+    if(n * MJ_SPLICE_MAX_MODIFIED > o->nsegments) {
+        return MJ_ERR_ENCODE_JPEG;
+    }
+
+    for(i = 0; i < o->ncomponents; i++) {
+        n = o->components[i];
+
+        if(mj_derive_huffcode(cinfo->dc_huff_tbl_ptrs[cinfo->comp_info[n].dc_tbl_no], &dc[i]) != MJ_OK) {
+            return MJ_ERR_ENCODE_JPEG;
+        }
+
+        if(mj_derive_huffcode(cinfo->ac_huff_tbl_ptrs[cinfo->comp_info[n].ac_tbl_no], &ac[i]) != MJ_OK) {
+            return MJ_ERR_ENCODE_JPEG;
+        }
+    }
+
+    bounds = (size_t *)mj_alloc(m->arena, 2 * o->nsegments * sizeof(size_t));
+    if(bounds == NULL) {
+        return MJ_ERR_MEMORY;
+    }
+
+    if(mj_find_segments(o, bounds) != MJ_OK) {
+        mj_release(m->arena, bounds);
+        return MJ_ERR_ENCODE_JPEG;
+    }
+
+    memset(&w, 0, sizeof(mj_bitwriter_t));
+
+    // the header is taken as it is, except for the markers that are not kept
+    if(mj_reserve(&w, o->len + MJ_MARKER_ORIENTATION_LEN) != MJ_OK) {
+        mj_release(m->arena, bounds);
+        return MJ_ERR_MEMORY;
+    }
+
+    w.len = mj_filter_markers(w.buf, o->data, o->scan, m->markers);
+
+    for(i = 0; i < o->nsegments; i++) {
+        if(i != 0) {
+            marker[0] = 0xFF;
+            marker[1] = (unsigned char)(JPEG_RST0 + ((i - 1) & 7));
+
+            rv = mj_reserve(&w, 2);
+            if(rv != MJ_OK) {
+                break;
+            }
+
+            mj_append(&w, marker, 2);
+        }
+
+        if(o->modified[i] == 0) {
+            rv = mj_reserve(&w, bounds[2 * i + 1] - bounds[2 * i]);
+            if(rv != MJ_OK) {
+                break;
+            }
+
+            mj_append(&w, o->data + bounds[2 * i], bounds[2 * i + 1] - bounds[2 * i]);
+        }
+        else {
+            rv = mj_encode_segment(m, &w, i, dc, ac);
+            if(rv != MJ_OK) {
+                break;
+            }
+        }
+    }
+
+    mj_release(m->arena, bounds);
+
+    if(rv == MJ_OK) {
+        rv = mj_reserve(&w, 2);
+    }
+
+    if(rv != MJ_OK) {
+        free(w.buf);
+        return rv;
+    }
+
+    marker[0] = 0xFF;
+    marker[1] = (unsigned char)JPEG_EOI;
+
+    mj_append(&w, marker, 2);
+
+    *memory = w.buf;
+    *len = w.len;
+
+    return MJ_OK;
+}
+
+void mj_splice_free(mj_jpeg_t *m) {
+    if(m->original.data != NULL) {
+        mj_release(m->arena, m->original.data);
+    }
+
+    if(m->original.modified != NULL) {
+        mj_release(m->arena, m->original.modified);
+    }
+
+    memset(&m->original, 0, sizeof(mj_original_t));
+
+    return;
+}
+
+static int mj_find_segments(mj_original_t *o, size_t *bounds) {
+    // bounds[2 * i] is the start and bounds[2 * i + 1] the end of the data of the i-th segment
+    const unsigned char *p;
+    size_t               pos = o->scan, next;
+    int                  segment = 0;
+
+    bounds[0] = pos;
+
+    while(pos < o->len) {
+        p = (const unsigned char *)memchr(o->data + pos, 0xFF, o->len - pos);
+        if(p == NULL) {
+            break;
+        }
+
+        pos = (size_t)(p - o->data);
+
+        // a marker can be preceded by any number of fill bytes
+        next = pos + 1;
+        while(next < o->len && o->data[next] == 0xFF) {
+            next++;
+        }
+
+        if(next == o->len) {
+            break;
+        }
+
+        // a stuffed zero byte
+        if(o->data[next] == 0x00) {
+            pos = next + 1;
+            continue;
+        }
+
+        bounds[2 * segment + 1] = pos;
+        segment++;
+
+        // any other marker than the next restart marker ends the scan
+        if(segment == o->nsegments || o->data[next] != JPEG_RST0 + ((segment - 1) & 7)) {
+            break;
+        }
+
+        bounds[2 * segment] = next + 1;
+        pos = next + 1;
+    }
+
+    if(segment != o->nsegments) {
+        return MJ_ERR_ENCODE_JPEG;
+    }
+
+    return MJ_OK;
+}
+
+static int mj_encode_segment(mj_jpeg_t *m, mj_bitwriter_t *w, int segment, mj_huffcode_t *dc, mj_huffcode_t *ac) {
+    struct jpeg_decompress_struct *cinfo = &m->cinfo;
+    mj_original_t *                o = &m->original;
+    jpeg_component_info *          component;
+    JBLOCKARRAY                    blocks;
+    int                            i, x, y, h = 1, v = 1, rv;
+    int                            mcu, mcu_start, mcu_end, mcu_row, mcu_col;
+    int                            last_dc[MAX_COMPS_IN_SCAN] = {0};
+
+    // the DC predictions start from 0 in each segment
+    mcu_start = segment * o->restart_interval;
+    mcu_end = mcu_start + o->restart_interval;
+    if(mcu_end > o->nmcus) {
+        mcu_end = o->nmcus;
+    }
+
+    for(mcu = mcu_start; mcu < mcu_end; mcu++) {
+        mcu_row = mcu / o->mcus_per_row;
+        mcu_col = mcu % o->mcus_per_row;
+
+        for(i = 0; i < o->ncomponents; i++) {
+            component = &cinfo->comp_info[o->components[i]];
+
+            if(o->ncomponents > 1) {
+                h = component->h_samp_factor;
+                v = component->v_samp_factor;
+            }
+
+            blocks = (*cinfo->mem->access_virt_barray)((j_common_ptr)cinfo, m->coef[o->components[i]], mcu_row * v, v, FALSE);
+
+            for(y = 0; y < v; y++) {
+                for(x = 0; x < h; x++) {
+                    if(mj_reserve(w, MJ_SPLICE_MAX_BLOCKSIZE) != MJ_OK) {
+                        return MJ_ERR_MEMORY;
+                    }
+
+                    rv = mj_encode_block(w, blocks[y][mcu_col * h + x], &last_dc[i], &dc[i], &ac[i]);
+                    if(rv != MJ_OK) {
+                        return rv;
+                    }
+                }
+            }
+        }
+    }
+
+    if(mj_reserve(w, 16) != MJ_OK) {
+        return MJ_ERR_MEMORY;
+    }
+
+    mj_flush_bits(w);
+
+    return MJ_OK;
+}
+
+static int mj_encode_block(mj_bitwriter_t *w, const JCOEF *coefs, int *last_dc, const mj_huffcode_t *dc, const mj_huffcode_t *ac) {
+    int k, r = 0, value, nbits, symbol;
+
+    value = coefs[0] - *last_dc;
+    *last_dc = coefs[0];
+
+    nbits = mj_count_bits(value);
+
+    // the symbols of a modified block may not be in the Huffman tables of the original
+    if(nbits > 11 || dc->size[nbits] == 0) {
+        return MJ_ERR_ENCODE_JPEG;
+    }
+
+    // negative values are coded as the one's complement
+    if(value < 0) {
+        value--;
+    }
+
+    mj_put_bits(w, (dc->code[nbits] << nbits) | ((unsigned int)value & ((1U << nbits) - 1)), dc->size[nbits] + nbits);
+
+    for(k = 1; k < DCTSIZE2; k++) {
+        value = coefs[mj_zigzag[k]];
+        if(value == 0) {
+            r++;
+            continue;
+        }
+
+        // runs of 16 zeros
+        while(r > 15) {
+            if(ac->size[0xF0] == 0) {
+                return MJ_ERR_ENCODE_JPEG;
+            }
+
+            mj_put_bits(w, ac->code[0xF0], ac->size[0xF0]);
+            r -= 16;
+        }
+
+        nbits = mj_count_bits(value);
+
+        symbol = (r << 4) + nbits;
+        if(nbits > 10 || ac->size[symbol] == 0) {
+            return MJ_ERR_ENCODE_JPEG;
+        }
+
+        if(value < 0) {
+            value--;
+        }
+
+        mj_put_bits(w, (ac->code[symbol] << nbits) | ((unsigned int)value & ((1U << nbits) - 1)), ac->size[symbol] + nbits);
+
+        r = 0;
+    }
+
+    // end of block
+    if(r > 0) {
+        if(ac->size[0x00] == 0) {
+            return MJ_ERR_ENCODE_JPEG;
+        }
+
+        mj_put_bits(w, ac->code[0x00], ac->size[0x00]);
+    }
+
+    return MJ_OK;
+}
+
+static int mj_derive_huffcode(const JHUFF_TBL *table, mj_huffcode_t *hc) {
+    unsigned int code = 0;
+    int          l, i, p = 0;
+
+    if(table == NULL) {
+        return MJ_ERR_ENCODE_JPEG;
+    }
+
+    memset(hc->size, 0, sizeof(hc->size));
+
+    // the codes are assigned in the order of the symbols, the shorter codes first
+    for(l = 1; l <= 16; l++) {
+        for(i = 0; i < table->bits[l]; i++) {
+            if(p == 256) {
+                return MJ_ERR_ENCODE_JPEG;
+            }
+
+            hc->code[table->huffval[p]] = code;
+            hc->size[table->huffval[p]] = (unsigned char)l;
+
+            code++;
+            p++;
+        }
+
+        if(code > (1U << l)) {
+            return MJ_ERR_ENCODE_JPEG;
+        }
+
+        code <<= 1;
+    }
+
+    return MJ_OK;
+}
+
+static int mj_count_bits(int value) {
+    if(value < 0) {
+        value = -value;
+    }
+
+    if(value < 256) {
+        return mj_nbits[value];
+    }
+
+    if(value < 65536) {
+        return 8 + mj_nbits[value >> 8];
+    }
+
+    return 17;
+}
+
+static int mj_reserve(mj_bitwriter_t *w, size_t n) {
+    size_t         size = w->size;
+    unsigned char *buf;
+
+    if(w->len + n <= w->size) {
+        return MJ_OK;
+    }
+
+    if(size < 4096) {
+        size = 4096;
+    }
+
+    while(size < w->len + n) {
+        size *= 2;
+    }
+
+    buf = (unsigned char *)realloc(w->buf, size);
+    if(buf == NULL) {
+        return MJ_ERR_MEMORY;
+    }
+
+    w->buf = buf;
+    w->size = size;
+
+    return MJ_OK;
+}
+
+static void mj_append(mj_bitwriter_t *w, const unsigned char *data, size_t n) {
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+
+    return;
+}
+
+static void mj_put_bits(mj_bitwriter_t *w, unsigned int code, int size) {
+    w->bits = (w->bits << size) | code;
+    w->nbits += size;
+
+    // the bytes are written in batches
+    if(w->nbits >= 32) {
+        mj_write_bytes(w);
+    }
+
+    return;
+}
+
+static void mj_write_bytes(mj_bitwriter_t *w) {
+    unsigned char c;
+
+    while(w->nbits >= 8) {
+        c = (unsigned char)(w->bits >> (w->nbits - 8));
+        w->nbits -= 8;
+
+        w->buf[w->len++] = c;
+        if(c == 0xFF) {
+            w->buf[w->len++] = 0x00;
+        }
+    }
+
+    return;
+}
+
+static void mj_flush_bits(mj_bitwriter_t *w) {
+    int padding = (8 - (w->nbits & 7)) & 7;
+
+    // the last byte of a segment is padded with 1-bits
+    w->bits = (w->bits << padding) | ((1U << padding) - 1);
+    w->nbits += padding;
+
+    mj_write_bytes(w);
+
+    w->bits = 0;
+    w->nbits = 0;
+
+    return;
+}
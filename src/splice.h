@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_SPLICE_H_
+#define _LIBMODJPEG_SPLICE_H_
+
+#include "libmodjpeg.h"
+
+// the derived Huffman table for encoding, a size of 0 means the symbol isn't in the table
+typedef struct {
+    unsigned int  code[256];
+    unsigned char size[256];
+} mj_huffcode_t;
+
+typedef struct {
+    unsigned char *buf;
+    size_t         len;
+    size_t         size;
+
+    unsigned long long bits;     // the lowest nbits bits are pending
+    int                nbits;
+} mj_bitwriter_t;
+
+int  mj_splice_init(mj_jpeg_t *m, const unsigned char *memory, size_t len, size_t scan);
+void mj_splice_mark(mj_jpeg_t *m, int component, int row_start, int row_end, int col_start, int col_end);
+int  mj_splice_jpeg(mj_jpeg_t *m, unsigned char **memory, size_t *len, int options);
+void mj_splice_free(mj_jpeg_t *m);
+
+#endif
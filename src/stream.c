@@ -0,0 +1,453 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stream.h"
+
+#include "image.h"
+#include "jpeg.h"
+#include "libmodjpeg.h"
+#include "marker.h"
+
+#include <jerror.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the image is decoded, processed, and encoded in bands of iMCU rows. the decoder runs in the calling
+// thread and writes into bands instead of a virtual block array for the whole image. when it moves on
+// to the next band, the band callback processes the previous one and the encoder thread picks it up.
+
+static mj_bandarray_t *mj_stream_array(mj_stream_t *s, jvirt_barray_ptr ptr);
+static jvirt_barray_ptr mj_stream_request_virt_barray(j_common_ptr cinfo, int pool_id, boolean pre_zero, JDIMENSION blocksperrow, JDIMENSION numrows, JDIMENSION maxaccess);
+static void             mj_stream_realize_virt_arrays(j_common_ptr cinfo);
+static JBLOCKARRAY      mj_stream_access_decoder(j_common_ptr cinfo, jvirt_barray_ptr ptr, JDIMENSION start_row, JDIMENSION num_rows, boolean writable);
+static JBLOCKARRAY      mj_stream_access_encoder(j_common_ptr cinfo, jvirt_barray_ptr ptr, JDIMENSION start_row, JDIMENSION num_rows, boolean writable);
+static void             mj_stream_next_band(mj_stream_t *s, int band);
+static void             mj_stream_finish_band(mj_stream_t *s);
+static void *           mj_stream_encode(void *arg);
+
+int mj_stream_jpeg_file(const char *infilename, const char *outfilename, int band_height, int options, mj_band_fn fn, void *arg) {
+    if(infilename == NULL || outfilename == NULL) {
+        return MJ_ERR_NULL_DATA;
+    }
+
+    // optimized Huffman tables and progressive JPEGs need all coefficients at once
+    if((options & (MJ_OPTION_OPTIMIZE | MJ_OPTION_PROGRESSIVE)) != 0) {
+        return MJ_ERR_UNSUPPORTED_STREAMING;
+    }
+
+    int          rv;
+    mj_stream_t *s = (mj_stream_t *)calloc(1, sizeof(mj_stream_t));
+    if(s == NULL) {
+        return MJ_ERR_MEMORY;
+    }
+
+    s->options = options;
+    s->fn = fn;
+    s->arg = arg;
+    s->band_height = band_height;
+
+    s->in = fopen(infilename, "rb");
+    if(s->in == NULL) {
+        free(s);
+        return MJ_ERR_FILEIO;
+    }
+
+    s->out = fopen(outfilename, "wb");
+    if(s->out == NULL) {
+        fclose(s->in);
+        free(s);
+        return MJ_ERR_FILEIO;
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    rv = mj_stream_jpeg(s);
+
+    fclose(s->in);
+    if(fclose(s->out) != 0 && rv == MJ_OK) {
+        rv = MJ_ERR_FILEIO;
+    }
+
+    // don't leave a partial image behind
+    if(rv != MJ_OK) {
+        remove(outfilename);
+    }
+
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+
+    free(s);
+
+    return rv;
+}
+
+int mj_stream_jpeg(mj_stream_t *s) {
+    struct jpeg_decompress_struct *cinfo = &s->m.cinfo;
+    struct mj_jpeg_error_mgr       jerr;
+
+    cinfo->err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = mj_jpeg_error_exit;
+    if(setjmp(jerr.setjmp_buffer)) {
+        // keeps an earlier error, e.g. from the band callback or the encoder
+        mj_stream_fail(s, MJ_ERR_DECODE_JPEG);
+
+        if(s->encoder_started == 1) {
+            pthread_join(s->encoder, NULL);
+        }
+
+        jpeg_destroy_decompress(cinfo);
+
+        return s->rv;
+    }
+
+    jpeg_create_decompress(cinfo);
+
+    cinfo->client_data = s;
+
+    jpeg_stdio_src(cinfo, s->in);
+
+    mj_save_markers(cinfo, MJ_MARKERS_ALL);
+
+    jpeg_read_header(cinfo, TRUE);
+
+    switch(cinfo->jpeg_color_space) {
+        case JCS_GRAYSCALE:
+        case JCS_RGB:
+        case JCS_YCbCr:
+            break;
+        default:
+            jpeg_destroy_decompress(cinfo);
+            return MJ_ERR_UNSUPPORTED_COLORSPACE;
+    }
+
+    // with more than one scan, each scan touches the whole image
+    if(jpeg_has_multiple_scans(cinfo) == TRUE) {
+        jpeg_destroy_decompress(cinfo);
+        return MJ_ERR_UNSUPPORTED_STREAMING;
+    }
+
+    // the height of a band in iMCU rows
+    int imcu_height = cinfo->max_v_samp_factor * DCTSIZE;
+
+    s->band_height = (s->band_height + imcu_height - 1) / imcu_height;
+    if(s->band_height < 1) {
+        s->band_height = 1;
+    }
+
+    s->nbands = ((int)cinfo->total_iMCU_rows + s->band_height - 1) / s->band_height;
+    s->decoding = -1;
+
+    s->request_virt_barray = cinfo->mem->request_virt_barray;
+    s->realize_virt_arrays = cinfo->mem->realize_virt_arrays;
+    s->access_virt_barray = cinfo->mem->access_virt_barray;
+
+    cinfo->mem->request_virt_barray = mj_stream_request_virt_barray;
+    cinfo->mem->realize_virt_arrays = mj_stream_realize_virt_arrays;
+    cinfo->mem->access_virt_barray = mj_stream_access_decoder;
+
+    if(pthread_create(&s->encoder, NULL, mj_stream_encode, s) != 0) {
+        jpeg_destroy_decompress(cinfo);
+        return MJ_ERR_MEMORY;
+    }
+
+    s->encoder_started = 1;
+
+    // returns after the last band has been decoded
+    jpeg_read_coefficients(cinfo);
+
+    mj_stream_finish_band(s);
+
+    pthread_join(s->encoder, NULL);
+
+    jpeg_destroy_decompress(cinfo);
+
+    return s->rv;
+}
+
+void mj_stream_fail(mj_stream_t *s, int rv) {
+    pthread_mutex_lock(&s->lock);
+
+    if(s->failed == 0) {
+        s->failed = 1;
+        s->rv = rv;
+    }
+
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    return;
+}
+
+static mj_bandarray_t *mj_stream_array(mj_stream_t *s, jvirt_barray_ptr ptr) {
+    int i;
+
+    for(i = 0; i < s->narrays; i++) {
+        if(ptr == s->coef[i]) {
+            return &s->arrays[i];
+        }
+    }
+
+    return NULL;
+}
+
+static jvirt_barray_ptr mj_stream_request_virt_barray(j_common_ptr cinfo, int pool_id, boolean pre_zero, JDIMENSION blocksperrow, JDIMENSION numrows, JDIMENSION maxaccess) {
+    mj_stream_t *s = (mj_stream_t *)cinfo->client_data;
+
+    if(s->narrays == MAX_COMPONENTS) {
+        ERREXIT(cinfo, JERR_NOT_COMPILED);
+    }
+
+    // the arrays are requested in the order of the components. the pointer is only compared, never dereferenced by libjpeg.
+    mj_bandarray_t *a = &s->arrays[s->narrays];
+
+    a->blocksperrow = blocksperrow;
+    a->numrows = numrows;
+
+    s->coef[s->narrays] = (jvirt_barray_ptr)a;
+    s->narrays++;
+
+    return s->coef[s->narrays - 1];
+}
+
+static void mj_stream_realize_virt_arrays(j_common_ptr cinfo) {
+    mj_stream_t *                  s = (mj_stream_t *)cinfo->client_data;
+    struct jpeg_decompress_struct *dinfo = (struct jpeg_decompress_struct *)cinfo;
+    int                            i, j;
+    mj_bandarray_t *               a;
+
+    (*s->realize_virt_arrays)(cinfo);
+
+    for(i = 0; i < s->narrays; i++) {
+        a = &s->arrays[i];
+
+        a->rows_per_band = (JDIMENSION)s->band_height * dinfo->comp_info[i].v_samp_factor;
+
+        for(j = 0; j < MJ_STREAM_NSLOTS; j++) {
+            a->slots[j] = (*cinfo->mem->alloc_barray)(cinfo, JPOOL_IMAGE, a->blocksperrow, a->rows_per_band);
+        }
+    }
+
+    return;
+}
+
+static JBLOCKARRAY mj_stream_access_decoder(j_common_ptr cinfo, jvirt_barray_ptr ptr, JDIMENSION start_row, JDIMENSION num_rows, boolean writable) {
+    mj_stream_t *   s = (mj_stream_t *)cinfo->client_data;
+    mj_bandarray_t *a = mj_stream_array(s, ptr);
+
+    if(a == NULL) {
+        return (*s->access_virt_barray)(cinfo, ptr, start_row, num_rows, writable);
+    }
+
+    int band = (int)(start_row / a->rows_per_band);
+
+    if(band != s->decoding) {
+        // the band callback can only access the current band
+        if(s->in_callback == 1) {
+            ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+        }
+
+        mj_stream_next_band(s, band);
+    }
+
+    if(start_row + num_rows > (JDIMENSION)(band + 1) * a->rows_per_band) {
+        ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+    }
+
+    return a->slots[band % MJ_STREAM_NSLOTS] + (start_row - (JDIMENSION)band * a->rows_per_band);
+}
+
+static void mj_stream_next_band(mj_stream_t *s, int band) {
+    j_common_ptr cinfo = (j_common_ptr)&s->m.cinfo;
+    int          i, failed;
+    JDIMENSION   l;
+
+    // the rows are decoded in order
+    if(band != s->decoding + 1) {
+        ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+    }
+
+    if(s->decoding == -1) {
+        // the decoding started, i.e. everything the encoder needs from the decoder is known
+        mj_setup_jpeg(&s->m);
+        s->m.coef = s->coef;
+
+        // the encoder only reads these markers. the decoder appends the markers that follow the image data.
+        jpeg_saved_marker_ptr marker;
+        s->markers = s->m.cinfo.marker_list;
+        for(marker = s->markers; marker != NULL; marker = marker->next) {
+            s->nmarkers++;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        s->ready = 1;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+    else {
+        mj_stream_finish_band(s);
+    }
+
+    // wait until the encoder is done with the band that was in the slot before
+    pthread_mutex_lock(&s->lock);
+    while(s->failed == 0 && band >= s->encoding + MJ_STREAM_NSLOTS) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    failed = s->failed;
+    pthread_mutex_unlock(&s->lock);
+
+    if(failed == 1) {
+        longjmp(((mj_jpeg_error_ptr)cinfo->err)->setjmp_buffer, 1);
+    }
+
+    // the decoder expects zeroed blocks
+    for(i = 0; i < s->narrays; i++) {
+        for(l = 0; l < s->arrays[i].rows_per_band; l++) {
+            memset(s->arrays[i].slots[band % MJ_STREAM_NSLOTS][l], 0, s->arrays[i].blocksperrow * sizeof(JBLOCK));
+        }
+    }
+
+    s->decoding = band;
+
+    return;
+}
+
+static void mj_stream_finish_band(mj_stream_t *s) {
+    j_common_ptr cinfo = (j_common_ptr)&s->m.cinfo;
+    int          rv = MJ_OK;
+
+    if(s->decoding == -1) {
+        ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+    }
+
+    if(s->fn != NULL) {
+        s->m.band_start = s->decoding * s->band_height;
+        s->m.band_end = s->m.band_start + s->band_height;
+        if(s->m.band_end > (int)s->m.cinfo.total_iMCU_rows) {
+            s->m.band_end = (int)s->m.cinfo.total_iMCU_rows;
+        }
+
+        s->in_callback = 1;
+        rv = s->fn(&s->m, s->arg);
+        s->in_callback = 0;
+
+        if(rv != MJ_OK) {
+            mj_stream_fail(s, rv);
+            longjmp(((mj_jpeg_error_ptr)cinfo->err)->setjmp_buffer, 1);
+        }
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->decoded = s->decoding + 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    return;
+}
+
+static JBLOCKARRAY mj_stream_access_encoder(j_common_ptr cinfo, jvirt_barray_ptr ptr, JDIMENSION start_row, JDIMENSION num_rows, boolean writable) {
+    mj_stream_t *   s = (mj_stream_t *)cinfo->client_data;
+    mj_bandarray_t *a = mj_stream_array(s, ptr);
+
+    if(a == NULL) {
+        return (*s->encoder_access_virt_barray)(cinfo, ptr, start_row, num_rows, writable);
+    }
+
+    int band = (int)(start_row / a->rows_per_band);
+
+    if(start_row + num_rows > (JDIMENSION)(band + 1) * a->rows_per_band) {
+        ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+    }
+
+    pthread_mutex_lock(&s->lock);
+
+    // the encoder never goes back, i.e. the slots of the bands before are free
+    if(band > s->encoding) {
+        s->encoding = band;
+        pthread_cond_broadcast(&s->cond);
+    }
+
+    while(s->failed == 0 && band >= s->decoded) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+
+    int failed = s->failed || band < s->encoding;
+
+    pthread_mutex_unlock(&s->lock);
+
+    if(failed == 1) {
+        longjmp(((mj_jpeg_error_ptr)cinfo->err)->setjmp_buffer, 1);
+    }
+
+    return a->slots[band % MJ_STREAM_NSLOTS] + (start_row - (JDIMENSION)band * a->rows_per_band);
+}
+
+static void *mj_stream_encode(void *arg) {
+    mj_stream_t *               s = (mj_stream_t *)arg;
+    struct jpeg_compress_struct cinfo;
+    struct mj_jpeg_error_mgr    jerr;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = mj_jpeg_error_exit;
+    if(setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_compress(&cinfo);
+        mj_stream_fail(s, MJ_ERR_ENCODE_JPEG);
+        return NULL;
+    }
+
+    jpeg_create_compress(&cinfo);
+
+    cinfo.client_data = s;
+
+    s->encoder_access_virt_barray = cinfo.mem->access_virt_barray;
+    cinfo.mem->access_virt_barray = mj_stream_access_encoder;
+
+    jpeg_stdio_dest(&cinfo, s->out);
+
+    pthread_mutex_lock(&s->lock);
+    while(s->failed == 0 && s->ready == 0) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    int failed = s->failed;
+    pthread_mutex_unlock(&s->lock);
+
+    if(failed == 1) {
+        jpeg_destroy_compress(&cinfo);
+        return NULL;
+    }
+
+    jpeg_copy_critical_parameters(&s->m.cinfo, &cinfo);
+
+    mj_set_write_options(&cinfo, s->options);
+
+    jpeg_write_coefficients(&cinfo, s->coef);
+
+    // markers that follow the image data are not copied, the decoder may still be adding them
+    mj_write_markers(&cinfo, s->markers, s->nmarkers, mj_get_write_markers(&cinfo, &s->m.cinfo, MJ_MARKERS_ALL));
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    return NULL;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2006+ Ingo Oppermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LIBMODJPEG_STREAM_H_
+#define _LIBMODJPEG_STREAM_H_
+
+#include "libmodjpeg.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+// the number of bands in memory. the decoder fills one band while the encoder reads the other.
+#define MJ_STREAM_NSLOTS 2
+
+// replaces a virtual block array of the decoder. only MJ_STREAM_NSLOTS bands are kept, band n is in slot n % MJ_STREAM_NSLOTS.
+typedef struct {
+    JDIMENSION  blocksperrow;
+    JDIMENSION  numrows;
+    JDIMENSION  rows_per_band;
+    JBLOCKARRAY slots[MJ_STREAM_NSLOTS];
+} mj_bandarray_t;
+
+typedef struct {
+    mj_jpeg_t m;    // the decompressor, the band callback gets it with the current band
+
+    FILE *in;
+    FILE *out;
+    int   options;
+
+    mj_band_fn fn;
+    void *     arg;
+
+    int band_height;    // in iMCU rows
+    int nbands;
+
+    jvirt_barray_ptr      coef[MAX_COMPONENTS];
+    mj_bandarray_t        arrays[MAX_COMPONENTS];
+    int                   narrays;
+    jpeg_saved_marker_ptr markers;     // the first saved marker when encoding starts
+    int                   nmarkers;    // the saved markers that are known when encoding starts
+
+    // the original methods of the memory managers
+    jvirt_barray_ptr (*request_virt_barray)(j_common_ptr cinfo, int pool_id, boolean pre_zero, JDIMENSION blocksperrow, JDIMENSION numrows, JDIMENSION maxaccess);
+    void (*realize_virt_arrays)(j_common_ptr cinfo);
+    JBLOCKARRAY (*access_virt_barray)(j_common_ptr cinfo, jvirt_barray_ptr ptr, JDIMENSION start_row, JDIMENSION num_rows, boolean writable);
+    JBLOCKARRAY (*encoder_access_virt_barray)(j_common_ptr cinfo, jvirt_barray_ptr ptr, JDIMENSION start_row, JDIMENSION num_rows, boolean writable);
+
+    pthread_t encoder;
+    int       encoder_started;
+    int       in_callback;
+    int       decoding;    // the band the decoder writes to, only used by the decoder
+
+    pthread_mutex_t lock;    // protects everything below
+    pthread_cond_t  cond;
+    int             ready;       // the encoder can start
+    int             decoded;     // the number of bands that are decoded and processed
+    int             encoding;    // the band the encoder reads from, the bands before are free
+    int             failed;
+    int             rv;
+} mj_stream_t;
+
+int  mj_stream_jpeg(mj_stream_t *s);
+void mj_stream_fail(mj_stream_t *s, int rv);
+
+#endif